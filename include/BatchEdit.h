@@ -0,0 +1,87 @@
+/**
+ * @file BatchEdit.h
+ * @brief Find/replace and scripted transforms applied across many decks.
+ * @author Ben Namo
+ */
+
+#ifndef BATCHEDIT_H
+#define BATCHEDIT_H
+
+#include "FlashCardDeck.h"
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Which side of a card a transform step applies to
+ */
+enum class EditField { Question, Answer, Both };
+
+/**
+ * @brief A single step of a transform
+ */
+struct EditStep {
+    enum Kind { Replace, RegexReplace, Trim, CollapseSpaces };
+
+    Kind kind = Replace;
+    EditField field = EditField::Both;
+    std::string find;
+    std::string replacement;
+    std::shared_ptr<const std::regex> pattern;
+};
+
+/**
+ * @brief An ordered list of steps applied to the text of every card
+ */
+class BatchTransform {
+public:
+    void addReplace(const std::string& find, const std::string& replacement, EditField field);
+    bool addRegexReplace(const std::string& pattern, const std::string& replacement, EditField field, std::string& error);
+    void addTrim(EditField field);
+    void addCollapseSpaces(EditField field);
+    bool parseScript(const std::string& script, std::string& error);
+
+    bool isEmpty() const;
+    std::string apply(const std::string& text, EditField side) const;
+
+private:
+    std::vector<EditStep> steps;
+};
+
+/**
+ * @brief The before and after text of one changed card
+ */
+struct CardEdit {
+    std::shared_ptr<FlashCardDeck> deck;
+    std::shared_ptr<FlashCard> card;
+    int index = 0;
+    std::string oldQuestion;
+    std::string oldAnswer;
+    std::string newQuestion;
+    std::string newAnswer;
+};
+
+/**
+ * @brief Every card change produced by running a transform over a set of
+ * decks. Nothing is modified until apply is called, and apply cannot fail
+ * part way, so the batch lands as a single undoable operation.
+ */
+class EditBatch {
+public:
+    static bool prepare(const std::vector<std::shared_ptr<FlashCardDeck>>& decks, const BatchTransform& transform, EditBatch& batch, std::string& error, unsigned threadCount = 0);
+
+    bool validate(std::string& error) const;
+    std::string preview(size_t maxEdits = 200) const;
+    void apply();
+    std::vector<std::shared_ptr<FlashCardDeck>> getDecks() const;
+
+    size_t size() const;
+    const std::vector<CardEdit>& getEdits() const;
+
+private:
+    std::vector<CardEdit> edits;
+};
+
+#endif
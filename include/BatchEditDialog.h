@@ -0,0 +1,40 @@
+/**
+ * @file BatchEditDialog.h
+ * @brief Dialog for previewing and applying a batch edit across decks.
+ * @author Ben Namo
+ */
+
+#ifndef BATCHEDITDIALOG_H
+#define BATCHEDITDIALOG_H
+
+#include <wx/wx.h>
+#include "BatchEdit.h"
+
+/**
+ * @brief Lets the user pick decks and a transform, shows a dry run of the
+ * changes, and hands back the prepared batch when the user applies it.
+ */
+class BatchEditDialog : public wxDialog {
+public:
+    BatchEditDialog(wxWindow* parent, const std::vector<std::shared_ptr<FlashCardDeck>>& decks);
+    EditBatch getBatch();
+
+private:
+    void OnModeChanged(wxCommandEvent& event);
+    void OnPreview(wxCommandEvent& event);
+    void OnApply(wxCommandEvent& event);
+    bool PrepareBatch();
+
+    std::vector<std::shared_ptr<FlashCardDeck>> decks;
+    EditBatch batch;
+
+    wxCheckListBox* deckList;
+    wxChoice* modeChoice;
+    wxChoice* fieldChoice;
+    wxTextCtrl* findText;
+    wxTextCtrl* replaceText;
+    wxTextCtrl* scriptText;
+    wxTextCtrl* previewText;
+};
+
+#endif
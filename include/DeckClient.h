@@ -0,0 +1,77 @@
+/**
+ * @file DeckClient.h
+ * @brief Connection from a study station to the local deck server.
+ * @author Ben Namo
+ */
+
+#ifndef DECKCLIENT_H
+#define DECKCLIENT_H
+
+#include "FlashCardDeck.h"
+#include "DeckProtocol.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A change pushed by the server to subscribed clients. Which fields
+ * are set depends on the kind of change.
+ */
+struct DeckNotification {
+    DeckProtocol::NotifyKind kind;
+    std::string deckName;
+    std::string question;
+    std::string answer;
+    int index = 0;
+};
+
+/**
+ * @brief Blocking client for the deck server. Each call waits for its reply;
+ * notifications that arrive in between are queued until pollNotifications
+ * is called. The client's own edits come back as notifications too, and
+ * notifications already reflected in a fetched deck are dropped, so
+ * applying them in order keeps a local copy identical to the server's.
+ */
+class DeckClient {
+public:
+    DeckClient();
+    ~DeckClient();
+
+    bool connectTo(const std::string& socketPath = DeckProtocol::DEFAULT_SOCKET_PATH);
+    bool isConnected() const;
+    std::string getLastError() const;
+
+    std::vector<std::shared_ptr<FlashCardDeck>> loadDecks();
+    std::shared_ptr<FlashCardDeck> loadDeck(const std::string& name);
+    bool createDeck(const std::string& name);
+    bool addCard(const std::string& deckName, const std::string& question, const std::string& answer);
+    bool removeCard(const std::string& deckName, int index);
+    bool save();
+    bool subscribe();
+
+    bool acquirePin(int pin);
+    bool releasePin(int pin);
+    bool setPin(int pin, bool on);
+
+    std::vector<DeckNotification> pollNotifications();
+
+private:
+    bool request(DeckProtocol::Opcode opcode, const std::string& payload, std::string& response);
+    bool sendRequest(DeckProtocol::Opcode opcode, const std::string& payload, uint32_t& requestId);
+    bool awaitReply(uint32_t requestId, std::string& response);
+    std::shared_ptr<FlashCardDeck> receiveDeck(const std::string& name, uint32_t requestId);
+    bool readFrame(DeckProtocol::Frame& frame, bool block);
+    void queueNotification(const DeckProtocol::Frame& frame);
+    void dropNotifications(const std::string& deckName);
+    void disconnect(const std::string& reason);
+
+    int fd;
+    uint32_t nextRequestId;
+    std::string inBuffer;
+    std::deque<DeckNotification> notifications;
+    std::string lastError;
+};
+
+#endif
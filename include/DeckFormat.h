@@ -0,0 +1,15 @@
+/**
+ * @file DeckFormat.h
+ * @brief Rules for what the deck files can store without changing on reload.
+ * @author Ben Namo
+ */
+
+#ifndef DECKFORMAT_H
+#define DECKFORMAT_H
+
+#include <string>
+
+bool isValidDeckName(const std::string& name);
+bool isValidCardText(const std::string& question, const std::string& answer, std::string& problem);
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file DeckHistory.h
+ * @brief Multi-level undo and redo built on persistent deck versions.
+ * @author Ben Namo
+ */
+
+#ifndef DECKHISTORY_H
+#define DECKHISTORY_H
+
+#include "FlashCardDeck.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The versions of one deck before and after an operation
+ */
+struct DeckChange {
+    std::shared_ptr<FlashCardDeck> deck;
+    FlashCardDeck::Version before;
+    FlashCardDeck::Version after;
+};
+
+/**
+ * @brief One undoable operation, which may span several decks
+ */
+struct HistoryEntry {
+    std::string description;
+    std::vector<DeckChange> changes;
+    size_t nodes = 0;
+};
+
+/**
+ * @brief Undo and redo stacks of deck versions. Since versions share
+ * structure, each entry costs only the nodes its operation touched. The
+ * oldest entries are dropped once there are more than the step limit, or
+ * once the entries together hold more unshared nodes than the node budget,
+ * so an operation that rewrote a whole library cannot pin many copies of
+ * it. The latest entry is always kept so it can be undone.
+ */
+class DeckHistory {
+public:
+    explicit DeckHistory(size_t limit = 100, size_t nodeBudget = 1000000);
+
+    HistoryEntry begin(const std::string& description, const std::vector<std::shared_ptr<FlashCardDeck>>& decks);
+    bool commit(HistoryEntry entry);
+    void clear();
+
+    bool canUndo() const;
+    bool canRedo() const;
+    std::string undoDescription() const;
+    std::string redoDescription() const;
+    bool undo();
+    bool redo();
+
+private:
+    size_t limit;
+    size_t nodeBudget;
+    size_t nodes = 0;
+    std::deque<HistoryEntry> undoStack;
+    std::vector<HistoryEntry> redoStack;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file DeckProtocol.h
+ * @brief Binary wire format shared by the deck server and its clients.
+ * @author Ben Namo
+ */
+
+#ifndef DECKPROTOCOL_H
+#define DECKPROTOCOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Every frame on the socket is laid out as
+ *   u32 length | u8 opcode | u32 request id | payload
+ * where length counts everything after itself. Integers are big endian and
+ * strings are a u32 length followed by the raw bytes.
+ */
+namespace DeckProtocol {
+
+const std::string DEFAULT_SOCKET_PATH = "/tmp/aromacards.sock";
+
+// Frames larger than this are treated as a protocol error
+const uint32_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+// Size of the length prefix plus the opcode and request id
+const size_t HEADER_SIZE = 9;
+
+// Largest payload that fits in a frame
+const size_t MAX_PAYLOAD_SIZE = MAX_FRAME_SIZE - (HEADER_SIZE - 4);
+
+enum Opcode : uint8_t {
+    // Requests
+    LIST_DECKS = 1,
+    GET_DECK = 2,
+    CREATE_DECK = 3,
+    ADD_CARD = 4,
+    REMOVE_CARD = 5,
+    SAVE = 6,
+    SUBSCRIBE = 7,
+    ACQUIRE_PIN = 8,
+    RELEASE_PIN = 9,
+    SET_PIN = 10,
+
+    // Replies and server pushed messages
+    REPLY_OK = 100,
+    REPLY_ERROR = 101,
+    NOTIFY = 102
+};
+
+/**
+ * A deck is sent back as one or more REPLY_OK frames with the request's id,
+ * so a deck of any size fits within MAX_FRAME_SIZE:
+ *   GET_DECK      u32 total cards | u32 cards in this frame | (string question | string answer)...
+ * The frames are queued together, so nothing else arrives between them.
+ */
+
+/**
+ * Notifications carry the change itself, so subscribers can apply it
+ * without fetching the deck again:
+ *   DECK_CREATED  u8 kind | string deck
+ *   CARD_ADDED    u8 kind | string deck | string question | string answer
+ *   CARD_REMOVED  u8 kind | string deck | u32 index
+ */
+enum NotifyKind : uint8_t {
+    DECK_CREATED = 1,
+    CARD_ADDED = 2,
+    CARD_REMOVED = 3
+};
+
+/**
+ * @brief A single decoded frame
+ */
+struct Frame {
+    uint8_t opcode = 0;
+    uint32_t requestId = 0;
+    std::string payload;
+};
+
+/**
+ * @brief Appends fields to a payload buffer
+ */
+class Writer {
+public:
+    void putU8(uint8_t value);
+    void putU32(uint32_t value);
+    void putString(const std::string& value);
+    const std::string& data() const;
+
+private:
+    std::string buffer;
+};
+
+/**
+ * @brief Reads fields back out of a payload, flagging truncated input
+ */
+class Reader {
+public:
+    explicit Reader(const std::string& data);
+    uint8_t getU8();
+    uint32_t getU32();
+    std::string getString();
+    bool ok() const;
+
+private:
+    const std::string& data;
+    size_t pos;
+    bool valid;
+};
+
+void appendFrame(std::string& out, uint8_t opcode, uint32_t requestId, const std::string& payload);
+bool extractFrame(std::string& in, size_t& offset, Frame& frame, bool& error);
+
+}
+
+#endif
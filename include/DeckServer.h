@@ -0,0 +1,93 @@
+/**
+ * @file DeckServer.h
+ * @brief Local daemon that owns the deck store and diffuser pins.
+ * @author Ben Namo
+ */
+
+#ifndef DECKSERVER_H
+#define DECKSERVER_H
+
+#include "FlashCardDeck.h"
+#include "DeckProtocol.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Serves the deck library and aroma pins to many study stations over
+ * a Unix domain socket. A single epoll loop handles every client; requests
+ * may be pipelined and are answered in order. SIGINT and SIGTERM are read
+ * through the same loop, so a signal can never slip in before it waits.
+ * Diffuser commands shell out, so they run in order on a worker thread
+ * rather than in the loop.
+ */
+class DeckServer {
+public:
+    explicit DeckServer(const std::string& socketPath = DeckProtocol::DEFAULT_SOCKET_PATH);
+    ~DeckServer();
+
+    bool start();
+    void run();
+
+private:
+    enum PinAction { PIN_INIT, PIN_ON, PIN_OFF };
+
+    struct Connection {
+        int fd = -1;
+        std::string inBuffer;
+        std::string outBuffer;
+        bool subscribed = false;
+        uint32_t events = 0;
+        bool closing = false;
+        std::set<int> pins;
+    };
+
+    void acceptClients();
+    void readClient(Connection& connection);
+    void handleFrames(Connection& connection);
+    void flushClient(Connection& connection);
+    void updateEvents(Connection& connection);
+    void closeClient(int fd);
+    void handleFrame(Connection& connection, const DeckProtocol::Frame& frame);
+    void reply(Connection& connection, uint32_t requestId, const std::string& payload);
+    void replyError(Connection& connection, uint32_t requestId, const std::string& message);
+    void notifySubscribers(const std::string& notification);
+    void releasePin(int pin);
+    void queuePinAction(int pin, PinAction action);
+    void runPinActions();
+    void saveIfDirty(bool force);
+    std::shared_ptr<FlashCardDeck> findDeck(const std::string& name);
+
+    std::string socketPath;
+    int listenFd;
+    int epollFd;
+    int signalFd;
+    bool running;
+
+    std::unordered_map<int, Connection> connections;
+    std::set<int> pendingWrites;
+    std::vector<int> pendingCloses;
+
+    std::vector<std::shared_ptr<FlashCardDeck>> decks;
+    std::unordered_map<std::string, std::shared_ptr<FlashCardDeck>> deckIndex;
+    bool dirty;
+    std::chrono::steady_clock::time_point lastSave;
+
+    std::map<int, int> pinOwners;
+    std::thread pinWorker;
+    std::mutex pinMutex;
+    std::condition_variable pinWake;
+    std::deque<std::pair<int, PinAction>> pinActions;
+    bool pinWorkerStopping;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file DeckSync.h
+ * @brief Content hashes and incremental sync between deck libraries.
+ * @author Ben Namo
+ */
+
+#ifndef DECKSYNC_H
+#define DECKSYNC_H
+
+#include "FlashCardDeck.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Name of the manifest file kept in every library directory
+const std::string MANIFEST_FILE = ".manifest";
+
+// Directory inside a library that lists, per deck, the hashes of removed or edited cards
+const std::string REMOVED_DIRECTORY = ".removed";
+
+/**
+ * @brief Content hash of a single deck, which does not depend on card order
+ */
+struct DeckDigest {
+    std::string name;
+    uint64_t digest = 0;
+    uint64_t fileSize = 0;
+    int64_t modified = 0;
+};
+
+/**
+ * @brief Content hashes of a whole library, keyed by deck name. Per-card
+ * hashes are not stored, they are recomputed only for decks whose digests
+ * differ, so reading the manifest costs one line per deck.
+ */
+struct LibraryManifest {
+    uint64_t digest = 0;
+    std::map<std::string, DeckDigest> decks;
+};
+
+/**
+ * @brief Summary of what a sync changed in the target library
+ */
+struct SyncReport {
+    int decksCompared = 0;
+    int decksChanged = 0;
+    int cardsAdded = 0;
+    int cardsReplaced = 0;
+    int cardsRemoved = 0;
+    int conflictsKept = 0;
+    uint64_t bytesTransferred = 0;
+};
+
+uint64_t hashCard(const std::string& question, const std::string& answer);
+std::vector<uint64_t> hashCards(const std::shared_ptr<FlashCardDeck> deck);
+DeckDigest digestDeck(const std::shared_ptr<FlashCardDeck> deck);
+void updateLibraryDigest(LibraryManifest& manifest);
+
+std::vector<uint64_t> readRemovedCards(const std::string& directory, const std::string& deckName);
+bool writeRemovedCards(const std::string& directory, const std::string& deckName, const std::vector<uint64_t>& hashes);
+void recordRemovedCards(const std::string& directory, const std::string& deckName, const FlashCardDeck::Version& before, const FlashCardDeck::Version& after);
+
+bool readManifest(const std::string& path, LibraryManifest& manifest);
+bool writeManifest(const std::string& path, const LibraryManifest& manifest);
+LibraryManifest refreshManifest(const std::string& directory);
+
+SyncReport syncLibraries(const std::string& sourceDirectory, const std::string& targetDirectory);
+bool exportBundle(const std::string& directory, const std::string& bundlePath);
+SyncReport importBundle(const std::string& bundlePath, const std::string& targetDirectory);
+
+#endif
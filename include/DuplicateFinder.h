@@ -0,0 +1,37 @@
+/**
+ * @file DuplicateFinder.h
+ * @brief Finds near-duplicate cards across a library with MinHash and LSH.
+ * @author Ben Namo
+ */
+
+#ifndef DUPLICATEFINDER_H
+#define DUPLICATEFINDER_H
+
+#include "FlashCardDeck.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * @brief A card together with the deck it belongs to
+ */
+struct CardRef {
+    std::shared_ptr<FlashCardDeck> deck;
+    std::shared_ptr<FlashCard> card;
+};
+
+/**
+ * @brief A group of cards that are likely duplicates of each other. Their
+ * answers agree once case and punctuation are ignored, so only the wording
+ * of the questions differs. The first card is the one kept when the
+ * cluster is merged.
+ */
+struct DuplicateCluster {
+    std::vector<CardRef> cards;
+    double similarity = 0;
+};
+
+std::vector<DuplicateCluster> findDuplicates(const std::vector<std::shared_ptr<FlashCardDeck>>& decks, double threshold = 0.8, unsigned threadCount = 0);
+int mergeClusters(const std::vector<DuplicateCluster>& clusters);
+
+#endif
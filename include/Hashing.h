@@ -0,0 +1,27 @@
+/**
+ * @file Hashing.h
+ * @brief Bit mixing shared by the sync hashes and duplicate detection.
+ * @author Ben Namo
+ */
+
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <cstdint>
+
+/**
+ * @brief Scrambles the bits of a 64 bit value (splitmix64 finalizer)
+ * @param x value to scramble
+ * @returns the scrambled value
+ */
+inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+#endif
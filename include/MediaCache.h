@@ -0,0 +1,83 @@
+/**
+ * @file MediaCache.h
+ * @brief Background decoding and an LRU cache of card images.
+ * @author Ben Namo
+ */
+
+#ifndef MEDIACACHE_H
+#define MEDIACACHE_H
+
+#include <wx/wx.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Pixels of an image decoded and scaled off the UI thread. Plain
+ * buffers are used because wxImage reference counts are not thread safe.
+ */
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> alpha;
+
+    size_t bytes() const { return rgb.size() + alpha.size(); }
+};
+
+/**
+ * @brief Decodes image files on a pool of worker threads, scaled to fit a
+ * display size, and keeps the results in a cache bounded by total bytes.
+ * The least recently used images are evicted first.
+ */
+class MediaCache {
+public:
+    MediaCache(size_t maxBytes, unsigned threadCount = 0);
+    ~MediaCache();
+
+    std::shared_ptr<const DecodedImage> get(const std::string& path, const wxSize& maxSize);
+    void request(const std::string& path, const wxSize& maxSize, std::function<void()> onReady);
+    void prefetch(const std::string& path, const wxSize& maxSize);
+
+private:
+    struct Job {
+        std::string path;
+        wxSize maxSize;
+        std::string key;
+        std::function<void()> onReady;
+    };
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const DecodedImage> image;
+    };
+
+    static std::string keyFor(const std::string& path, const wxSize& maxSize);
+    static std::shared_ptr<const DecodedImage> decode(const std::string& path, const wxSize& maxSize);
+    void enqueue(Job job, bool urgent);
+    void insert(const std::string& key, std::shared_ptr<const DecodedImage> image);
+    void workerLoop();
+
+    size_t maxBytes;
+    size_t usedBytes;
+
+    std::mutex mutex;
+    std::condition_variable jobsAvailable;
+    std::deque<Job> jobs;
+    std::unordered_map<std::string, std::vector<std::function<void()>>> inFlight;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    bool stopping;
+    std::vector<std::thread> workers;
+};
+
+#endif
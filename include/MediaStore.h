@@ -0,0 +1,25 @@
+/**
+ * @file MediaStore.h
+ * @brief Content-addressed storage of card media next to the deck files.
+ * @author Ben Namo
+ */
+
+#ifndef MEDIASTORE_H
+#define MEDIASTORE_H
+
+#include "FlashCardDeck.h"
+
+#include <memory>
+#include <string>
+
+// Directory inside a library that holds media files and per-deck references
+const std::string MEDIA_DIRECTORY = ".media";
+
+std::string hashMediaFile(const std::string& path);
+std::string importMedia(const std::string& libraryDirectory, const std::string& sourcePath);
+std::string mediaPath(const std::string& libraryDirectory, const std::string& hash);
+
+bool saveMediaRefs(const std::shared_ptr<FlashCardDeck> deck, const std::string& libraryDirectory);
+void loadMediaRefs(const std::shared_ptr<FlashCardDeck> deck, const std::string& libraryDirectory);
+
+#endif
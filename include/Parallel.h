@@ -0,0 +1,59 @@
+/**
+ * @file Parallel.h
+ * @brief Helper for splitting library-wide work across threads.
+ * @author Ben Namo
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Gets the number of threads to use for library-wide work
+ * @param requested a requested thread count, 0 for one per core
+ * @returns the thread count to use, at least one
+ */
+inline unsigned threadCountFor(unsigned requested)
+{
+    return requested != 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Runs a function over the range [0, count) split across threads.
+ * An exception thrown by a slice is rethrown here once every thread has
+ * finished, rather than terminating the program from inside the thread.
+ * @param count number of items
+ * @param threadCount number of threads to use
+ * @param work called with each thread's [begin, end) slice and thread index
+ */
+template <typename Work>
+void parallelFor(size_t count, unsigned threadCount, Work work)
+{
+    std::vector<std::thread> threads;
+    std::vector<std::exception_ptr> failures(threadCount);
+    size_t chunk = (count + threadCount - 1) / threadCount;
+    for (unsigned t = 0; t < threadCount; t++) {
+        size_t begin = std::min(count, t * chunk);
+        size_t end = std::min(count, begin + chunk);
+        threads.emplace_back([&work, &failures, begin, end, t]() {
+            try {
+                work(begin, end, t);
+            } catch (...) {
+                failures[t] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    for (std::exception_ptr& failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+}
+
+#endif
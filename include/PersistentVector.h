@@ -0,0 +1,308 @@
+/**
+ * @file PersistentVector.h
+ * @brief Immutable sequence with structural sharing between versions.
+ * @author Ben Namo
+ */
+
+#ifndef PERSISTENTVECTOR_H
+#define PERSISTENTVECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief An immutable sequence stored as an AVL tree ordered by position.
+ * Every update returns a new version in O(log n) time and memory: only the
+ * nodes on the path to the changed position are copied, everything else is
+ * shared with the old version. Copying a version is O(1), and versions may
+ * be read from several threads at once.
+ */
+template <typename T>
+class PersistentVector {
+public:
+    PersistentVector() = default;
+
+    /**
+     * @brief Builds a balanced version holding the given items in O(n)
+     * @param items the items, in order
+     */
+    explicit PersistentVector(const std::vector<T>& items) : root(build(items, 0, items.size())) {}
+
+    /**
+     * @brief Gets the number of items
+     * @returns the size of the sequence
+     */
+    size_t size() const { return sizeOf(root); }
+
+    /**
+     * @brief Whether the sequence is empty
+     * @returns true if there are no items
+     */
+    bool empty() const { return !root; }
+
+    /**
+     * @brief Gets the item at a position
+     * @param index the position, which must be less than size()
+     * @returns the item
+     */
+    const T& at(size_t index) const
+    {
+        if (index >= size())
+            throw std::out_of_range("PersistentVector index out of range");
+        const Node* node = root.get();
+        while (true) {
+            size_t leftSize = sizeOf(node->left);
+            if (index < leftSize) {
+                node = node->left.get();
+            } else if (index > leftSize) {
+                index -= leftSize + 1;
+                node = node->right.get();
+            } else {
+                return node->value;
+            }
+        }
+    }
+
+    /**
+     * @brief Adds an item at the end
+     * @param value the item to add
+     * @returns the new version
+     */
+    PersistentVector pushBack(const T& value) const { return insert(size(), value); }
+
+    /**
+     * @brief Inserts an item before a position
+     * @param index the position, at most size()
+     * @param value the item to insert
+     * @returns the new version
+     */
+    PersistentVector insert(size_t index, const T& value) const
+    {
+        if (index > size())
+            throw std::out_of_range("PersistentVector index out of range");
+        return PersistentVector(insertAt(root, index, value));
+    }
+
+    /**
+     * @brief Removes the item at a position
+     * @param index the position, which must be less than size()
+     * @returns the new version
+     */
+    PersistentVector erase(size_t index) const
+    {
+        if (index >= size())
+            throw std::out_of_range("PersistentVector index out of range");
+        return PersistentVector(eraseAt(root, index));
+    }
+
+    /**
+     * @brief Replaces the item at a position
+     * @param index the position, which must be less than size()
+     * @param value the new item
+     * @returns the new version
+     */
+    PersistentVector set(size_t index, const T& value) const
+    {
+        if (index >= size())
+            throw std::out_of_range("PersistentVector index out of range");
+        return PersistentVector(setAt(root, index, value));
+    }
+
+    /**
+     * @brief Calls a function on every item in order
+     * @param visit the function to call
+     */
+    template <typename Visit>
+    void forEach(Visit visit) const { visitAll(root.get(), visit); }
+
+    /**
+     * @brief Copies the items into a plain vector
+     * @returns the items, in order
+     */
+    std::vector<T> toVector() const
+    {
+        std::vector<T> items;
+        items.reserve(size());
+        forEach([&](const T& value) { items.push_back(value); });
+        return items;
+    }
+
+    /**
+     * @brief Whether two versions are the same version, in O(1)
+     * @param other the version to compare with
+     * @returns true if both share the same tree
+     */
+    bool sameVersion(const PersistentVector& other) const { return root == other.root; }
+
+    /**
+     * @brief Counts the nodes of this version that another version does not
+     * share, which is the memory this version alone keeps alive. Both trees
+     * are walked from the tallest node down, so a subtree both versions share
+     * is met at the same height in each and skipped whole. The cost is
+     * proportional to the nodes that differ rather than to the size.
+     * @param other the version to compare with
+     * @returns the number of nodes only this version holds
+     */
+    size_t countNodesNotIn(const PersistentVector& other) const
+    {
+        using Entry = std::pair<int, const Node*>;
+        std::priority_queue<Entry> mine;
+        std::priority_queue<Entry> theirs;
+        std::unordered_set<const Node*> theirFrontier;
+        if (root)
+            mine.push({root->height, root.get()});
+        if (other.root) {
+            theirs.push({other.root->height, other.root.get()});
+            theirFrontier.insert(other.root.get());
+        }
+
+        size_t count = 0;
+        while (!mine.empty()) {
+            int height = mine.top().first;
+
+            // Opens the other tree down to this height, so any node of it this tall is in the frontier
+            while (!theirs.empty() && theirs.top().first > height) {
+                const Node* node = theirs.top().second;
+                theirs.pop();
+                if (theirFrontier.erase(node) == 0)
+                    continue;
+                for (const NodePtr* child : { &node->left, &node->right }) {
+                    if (*child) {
+                        theirs.push({(*child)->height, child->get()});
+                        theirFrontier.insert(child->get());
+                    }
+                }
+            }
+
+            const Node* node = mine.top().second;
+            mine.pop();
+            // A shared subtree is dropped from both walks
+            if (theirFrontier.erase(node) != 0)
+                continue;
+            count++;
+            for (const NodePtr* child : { &node->left, &node->right }) {
+                if (*child)
+                    mine.push({(*child)->height, child->get()});
+            }
+        }
+        return count;
+    }
+
+private:
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        T value;
+        NodePtr left;
+        NodePtr right;
+        size_t size;
+        int height;
+    };
+
+    explicit PersistentVector(NodePtr root) : root(std::move(root)) {}
+
+    static size_t sizeOf(const NodePtr& node) { return node ? node->size : 0; }
+    static int heightOf(const NodePtr& node) { return node ? node->height : 0; }
+
+    static NodePtr make(const T& value, NodePtr left, NodePtr right)
+    {
+        size_t size = sizeOf(left) + sizeOf(right) + 1;
+        int height = std::max(heightOf(left), heightOf(right)) + 1;
+        return std::make_shared<const Node>(Node{value, std::move(left), std::move(right), size, height});
+    }
+
+    // Builds a node from its parts, rotating if the subtree heights differ by two
+    static NodePtr balance(const T& value, NodePtr left, NodePtr right)
+    {
+        int leftHeight = heightOf(left);
+        int rightHeight = heightOf(right);
+        if (leftHeight > rightHeight + 1) {
+            if (heightOf(left->left) >= heightOf(left->right))
+                return make(left->value, left->left, make(value, left->right, right));
+            const NodePtr& middle = left->right;
+            return make(middle->value, make(left->value, left->left, middle->left), make(value, middle->right, right));
+        }
+        if (rightHeight > leftHeight + 1) {
+            if (heightOf(right->right) >= heightOf(right->left))
+                return make(right->value, make(value, left, right->left), right->right);
+            const NodePtr& middle = right->left;
+            return make(middle->value, make(value, left, middle->left), make(right->value, middle->right, right->right));
+        }
+        return make(value, std::move(left), std::move(right));
+    }
+
+    static NodePtr insertAt(const NodePtr& node, size_t index, const T& value)
+    {
+        if (!node)
+            return make(value, nullptr, nullptr);
+        size_t leftSize = sizeOf(node->left);
+        if (index <= leftSize)
+            return balance(node->value, insertAt(node->left, index, value), node->right);
+        return balance(node->value, node->left, insertAt(node->right, index - leftSize - 1, value));
+    }
+
+    static NodePtr removeFirst(const NodePtr& node, T& first)
+    {
+        if (!node->left) {
+            first = node->value;
+            return node->right;
+        }
+        return balance(node->value, removeFirst(node->left, first), node->right);
+    }
+
+    static NodePtr eraseAt(const NodePtr& node, size_t index)
+    {
+        size_t leftSize = sizeOf(node->left);
+        if (index < leftSize)
+            return balance(node->value, eraseAt(node->left, index), node->right);
+        if (index > leftSize)
+            return balance(node->value, node->left, eraseAt(node->right, index - leftSize - 1));
+
+        // Replaces the removed node with the first node of its right subtree
+        if (!node->right)
+            return node->left;
+        if (!node->left)
+            return node->right;
+        T successor = node->value;
+        NodePtr right = removeFirst(node->right, successor);
+        return balance(successor, node->left, right);
+    }
+
+    static NodePtr setAt(const NodePtr& node, size_t index, const T& value)
+    {
+        size_t leftSize = sizeOf(node->left);
+        if (index < leftSize)
+            return make(node->value, setAt(node->left, index, value), node->right);
+        if (index > leftSize)
+            return make(node->value, node->left, setAt(node->right, index - leftSize - 1, value));
+        return make(value, node->left, node->right);
+    }
+
+    static NodePtr build(const std::vector<T>& items, size_t begin, size_t end)
+    {
+        if (begin >= end)
+            return nullptr;
+        size_t middle = begin + (end - begin) / 2;
+        return make(items[middle], build(items, begin, middle), build(items, middle + 1, end));
+    }
+
+    template <typename Visit>
+    static void visitAll(const Node* node, Visit& visit)
+    {
+        if (!node)
+            return;
+        visitAll(node->left.get(), visit);
+        visit(node->value);
+        visitAll(node->right.get(), visit);
+    }
+
+    NodePtr root;
+};
+
+#endif
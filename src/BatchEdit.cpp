@@ -0,0 +1,413 @@
+/**
+ * @file BatchEdit.cpp
+ * @brief Implementation of batch transforms and edit batches.
+ * @author Ben Namo
+ */
+
+#include "../include/BatchEdit.h"
+#include "../include/Parallel.h"
+#include "../include/DeckFormat.h"
+
+#include <sstream>
+
+/**
+ * @brief Whether a character counts as whitespace for trimming and collapsing
+ * @param c the character
+ * @returns true for spaces and tabs
+*/
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief Splits a script line into words, where quoted strings with
+ * backslash escapes count as one word
+ * @param line the line to split
+ * @param words receives the words
+ * @returns false if a quote is left open
+*/
+static bool splitWords(const std::string& line, std::vector<std::string>& words)
+{
+    size_t i = 0;
+    while (i < line.size()) {
+        if (isBlank(line[i])) {
+            i++;
+            continue;
+        }
+
+        std::string word;
+        if (line[i] == '"') {
+            i++;
+            while (i < line.size() && line[i] != '"') {
+                if (line[i] == '\\' && i + 1 < line.size())
+                    i++;
+                word += line[i++];
+            }
+            if (i >= line.size())
+                return false;
+            i++;
+        } else {
+            while (i < line.size() && !isBlank(line[i]))
+                word += line[i++];
+        }
+        words.push_back(word);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads an optional field name from a script line
+ * @param words the words of the line
+ * @param index position of the field name
+ * @param field receives the field, Both if the name is absent
+ * @returns false if the name is not question, answer or both
+*/
+static bool parseField(const std::vector<std::string>& words, size_t index, EditField& field)
+{
+    field = EditField::Both;
+    if (index >= words.size())
+        return true;
+    if (words[index] == "question")
+        field = EditField::Question;
+    else if (words[index] == "answer")
+        field = EditField::Answer;
+    else if (words[index] != "both")
+        return false;
+    return index + 1 == words.size();
+}
+
+/**
+ * @brief Adds a literal find and replace step
+ * @param find the text to find
+ * @param replacement the text to put in its place
+ * @param field the side of the card to edit
+*/
+void BatchTransform::addReplace(const std::string& find, const std::string& replacement, EditField field)
+{
+    EditStep step;
+    step.kind = EditStep::Replace;
+    step.field = field;
+    step.find = find;
+    step.replacement = replacement;
+    steps.push_back(step);
+}
+
+/**
+ * @brief Adds a regular expression replace step, using ECMAScript syntax
+ * and $1 style references in the replacement
+ * @param pattern the expression to match
+ * @param replacement the text to put in its place
+ * @param field the side of the card to edit
+ * @param error receives a message if the pattern is invalid
+ * @returns false if the pattern is invalid
+*/
+bool BatchTransform::addRegexReplace(const std::string& pattern, const std::string& replacement, EditField field, std::string& error)
+{
+    EditStep step;
+    step.kind = EditStep::RegexReplace;
+    step.field = field;
+    step.find = pattern;
+    step.replacement = replacement;
+    try {
+        step.pattern = std::make_shared<const std::regex>(pattern);
+    } catch (const std::regex_error& e) {
+        error = "Invalid regular expression \"" + pattern + "\": " + e.what();
+        return false;
+    }
+    steps.push_back(step);
+    return true;
+}
+
+/**
+ * @brief Adds a step stripping leading and trailing whitespace
+ * @param field the side of the card to edit
+*/
+void BatchTransform::addTrim(EditField field)
+{
+    EditStep step;
+    step.kind = EditStep::Trim;
+    step.field = field;
+    steps.push_back(step);
+}
+
+/**
+ * @brief Adds a step collapsing runs of whitespace to a single space
+ * @param field the side of the card to edit
+*/
+void BatchTransform::addCollapseSpaces(EditField field)
+{
+    EditStep step;
+    step.kind = EditStep::CollapseSpaces;
+    step.field = field;
+    steps.push_back(step);
+}
+
+/**
+ * @brief Adds the steps of a transform script, one command per line:
+ *   replace "find" "replacement" [question|answer|both]
+ *   regex "pattern" "replacement" [question|answer|both]
+ *   trim [question|answer|both]
+ *   collapse [question|answer|both]
+ * Blank lines and lines starting with # are ignored.
+ * @param script the script text
+ * @param error receives a message naming the first bad line
+ * @returns false if the script has an error
+*/
+bool BatchTransform::parseScript(const std::string& script, std::string& error)
+{
+    std::istringstream lines(script);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        std::vector<std::string> words;
+        if (!splitWords(line, words)) {
+            error = "Line " + std::to_string(lineNumber) + ": unterminated quote";
+            return false;
+        }
+        if (words.empty() || words[0][0] == '#')
+            continue;
+
+        EditField field;
+        const std::string& command = words[0];
+        if ((command == "replace" || command == "regex") && words.size() >= 3 && parseField(words, 3, field)) {
+            if (command == "replace") {
+                addReplace(words[1], words[2], field);
+            } else if (!addRegexReplace(words[1], words[2], field, error)) {
+                error = "Line " + std::to_string(lineNumber) + ": " + error;
+                return false;
+            }
+        } else if (command == "trim" && parseField(words, 1, field)) {
+            addTrim(field);
+        } else if (command == "collapse" && parseField(words, 1, field)) {
+            addCollapseSpaces(field);
+        } else {
+            error = "Line " + std::to_string(lineNumber) + ": cannot understand \"" + line + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Whether the transform has no steps
+ * @returns true if applying it would change nothing
+*/
+bool BatchTransform::isEmpty() const
+{
+    return steps.empty();
+}
+
+/**
+ * @brief Runs every step that applies to one side of a card
+ * @param text the question or answer text
+ * @param side which side the text is, Question or Answer
+ * @returns the transformed text
+*/
+std::string BatchTransform::apply(const std::string& text, EditField side) const
+{
+    std::string result = text;
+    for (const EditStep& step : steps) {
+        if (step.field != EditField::Both && step.field != side)
+            continue;
+
+        switch (step.kind) {
+        case EditStep::Replace: {
+            if (step.find.empty() || result.find(step.find) == std::string::npos)
+                break;
+            std::string replaced;
+            size_t start = 0;
+            size_t match;
+            while ((match = result.find(step.find, start)) != std::string::npos) {
+                replaced.append(result, start, match - start);
+                replaced += step.replacement;
+                start = match + step.find.size();
+            }
+            replaced.append(result, start, std::string::npos);
+            result = replaced;
+            break;
+        }
+        case EditStep::RegexReplace:
+            result = std::regex_replace(result, *step.pattern, step.replacement);
+            break;
+        case EditStep::Trim: {
+            size_t begin = 0;
+            size_t end = result.size();
+            while (begin < end && isBlank(result[begin]))
+                begin++;
+            while (end > begin && isBlank(result[end - 1]))
+                end--;
+            result = result.substr(begin, end - begin);
+            break;
+        }
+        case EditStep::CollapseSpaces: {
+            std::string collapsed;
+            for (char c : result) {
+                if (!isBlank(c))
+                    collapsed += c;
+                else if (collapsed.empty() || collapsed.back() != ' ')
+                    collapsed += ' ';
+            }
+            result = collapsed;
+            break;
+        }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Runs a transform over every card of the given decks without
+ * changing them, splitting the cards across threads
+ * @param decks the decks to transform
+ * @param transform the transform to run
+ * @param batch receives the cards the transform would change, in deck order
+ * @param error receives a message naming the card a regular expression
+ * could not be run on, for instance because the text is too long for it
+ * @param threadCount number of threads to use, 0 for one per core
+ * @returns false if the transform failed on some card
+*/
+bool EditBatch::prepare(const std::vector<std::shared_ptr<FlashCardDeck>>& decks, const BatchTransform& transform, EditBatch& batch, std::string& error, unsigned threadCount)
+{
+    struct DeckCard {
+        std::shared_ptr<FlashCardDeck> deck;
+        std::shared_ptr<FlashCard> card;
+        int index;
+    };
+    std::vector<DeckCard> cards;
+    for (std::shared_ptr<FlashCardDeck> deck : decks) {
+        int index = 0;
+        for (std::shared_ptr<FlashCard> card : deck->getCards())
+            cards.push_back({deck, card, index++});
+    }
+
+    // Each thread collects the edits of its own slice, joined in order afterwards.
+    // A slice stops at the first card its regex fails on and keeps the reason.
+    threadCount = threadCountFor(threadCount);
+    std::vector<std::vector<CardEdit>> threadEdits(threadCount);
+    std::vector<std::string> threadErrors(threadCount);
+    parallelFor(cards.size(), threadCount, [&](size_t begin, size_t end, unsigned t) {
+        for (size_t i = begin; i < end; i++) {
+            CardEdit edit;
+            edit.oldQuestion = cards[i].card->getQuestion();
+            edit.oldAnswer = cards[i].card->getAnswer();
+            try {
+                edit.newQuestion = transform.apply(edit.oldQuestion, EditField::Question);
+                edit.newAnswer = transform.apply(edit.oldAnswer, EditField::Answer);
+            } catch (const std::regex_error& e) {
+                threadErrors[t] = "The card \"" + edit.oldQuestion + "\" in " + cards[i].deck->getName()
+                    + " could not be edited: " + e.what();
+                return;
+            }
+            if (edit.newQuestion != edit.oldQuestion || edit.newAnswer != edit.oldAnswer) {
+                edit.deck = cards[i].deck;
+                edit.card = cards[i].card;
+                edit.index = cards[i].index;
+                threadEdits[t].push_back(std::move(edit));
+            }
+        }
+    });
+
+    for (const std::string& threadError : threadErrors) {
+        if (!threadError.empty()) {
+            error = threadError;
+            return false;
+        }
+    }
+
+    batch.edits.clear();
+    for (std::vector<CardEdit>& edits : threadEdits) {
+        for (CardEdit& edit : edits)
+            batch.edits.push_back(std::move(edit));
+    }
+    return true;
+}
+
+/**
+ * @brief Checks that every edited card can still be saved and loaded. The
+ * deck files hold one "question:answer" line per card, so a question may
+ * not contain a colon, neither side may contain a line break, and neither
+ * may be empty.
+ * @param error receives a message naming the first bad card
+ * @returns true if the batch is safe to apply
+*/
+bool EditBatch::validate(std::string& error) const
+{
+    for (const CardEdit& edit : edits) {
+        std::string problem;
+        if (!isValidCardText(edit.newQuestion, edit.newAnswer, problem)) {
+            error = "The card \"" + edit.oldQuestion + "\" in " + edit.deck->getName() + " would have " + problem + ".";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Describes the batch as a diff, one removed and one added line per
+ * changed side of each card
+ * @param maxEdits the number of cards to describe before summarising
+ * @returns the preview text
+*/
+std::string EditBatch::preview(size_t maxEdits) const
+{
+    std::string result;
+    for (size_t i = 0; i < edits.size() && i < maxEdits; i++) {
+        const CardEdit& edit = edits[i];
+        result += "[" + edit.deck->getName() + "]\n";
+        if (edit.newQuestion != edit.oldQuestion)
+            result += "- Q: " + edit.oldQuestion + "\n+ Q: " + edit.newQuestion + "\n";
+        if (edit.newAnswer != edit.oldAnswer)
+            result += "- A: " + edit.oldAnswer + "\n+ A: " + edit.newAnswer + "\n";
+    }
+    if (edits.size() > maxEdits)
+        result += "... and " + std::to_string(edits.size() - maxEdits) + " more cards\n";
+    if (edits.empty())
+        result = "No cards would change.\n";
+    return result;
+}
+
+/**
+ * @brief Replaces every edited card with one holding the new text. The old
+ * cards are left as they were, so earlier deck versions keep them.
+*/
+void EditBatch::apply()
+{
+    for (CardEdit& edit : edits) {
+        if (edit.deck->getCard(edit.index) == edit.card)
+            edit.deck->editCard(edit.index, edit.newQuestion, edit.newAnswer);
+    }
+}
+
+/**
+ * @brief Gets the decks the batch changes, for recording in the deck history
+ * @returns each edited deck once, in deck order
+*/
+std::vector<std::shared_ptr<FlashCardDeck>> EditBatch::getDecks() const
+{
+    std::vector<std::shared_ptr<FlashCardDeck>> decks;
+    for (const CardEdit& edit : edits) {
+        if (decks.empty() || decks.back() != edit.deck)
+            decks.push_back(edit.deck);
+    }
+    return decks;
+}
+
+/**
+ * @brief Gets the number of cards the batch changes
+ * @returns the number of edited cards
+*/
+size_t EditBatch::size() const
+{
+    return edits.size();
+}
+
+/**
+ * @brief Gets the individual card edits
+ * @returns the edits, in deck order
+*/
+const std::vector<CardEdit>& EditBatch::getEdits() const
+{
+    return edits;
+}
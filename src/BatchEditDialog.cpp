@@ -0,0 +1,172 @@
+/**
+ * @file BatchEditDialog.cpp
+ * @brief Implementation of the BatchEditDialog class.
+ * @author Ben Namo
+ */
+
+#include "../include/BatchEditDialog.h"
+
+/**
+ * @brief Constructor for the BatchEditDialog class.
+ * @param parent The parent window.
+ * @param decks The decks the user can choose to edit.
+ */
+BatchEditDialog::BatchEditDialog(wxWindow* parent, const std::vector<std::shared_ptr<FlashCardDeck>>& decks)
+    : wxDialog(parent, wxID_ANY, "Batch Edit", wxDefaultPosition, wxSize(700, 600), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER), decks(decks) {
+
+    // Create UI elements
+    deckList = new wxCheckListBox(this, wxID_ANY, wxDefaultPosition, wxSize(-1, 120));
+    for (std::shared_ptr<FlashCardDeck> deck : decks) {
+        deckList->Check(deckList->Append(wxString::FromUTF8(deck->getName())));
+    }
+
+    wxArrayString modes;
+    modes.Add("Find and replace");
+    modes.Add("Regex replace");
+    modes.Add("Script");
+    modeChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, modes);
+    modeChoice->SetSelection(0);
+
+    wxArrayString fields;
+    fields.Add("Question and answer");
+    fields.Add("Question");
+    fields.Add("Answer");
+    fieldChoice = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, fields);
+    fieldChoice->SetSelection(0);
+
+    findText = new wxTextCtrl(this, wxID_ANY);
+    replaceText = new wxTextCtrl(this, wxID_ANY);
+    scriptText = new wxTextCtrl(this, wxID_ANY, "# replace \"find\" \"with\" [question|answer|both]\n# regex \"pattern\" \"with\" [field]\n# trim [field]\n# collapse [field]\n",
+                                wxDefaultPosition, wxSize(-1, 80), wxTE_MULTILINE);
+    scriptText->Disable();
+    previewText = new wxTextCtrl(this, wxID_ANY, "", wxDefaultPosition, wxSize(-1, 200), wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP);
+
+    wxButton* previewButton = new wxButton(this, wxID_ANY, "Preview");
+    wxButton* applyButton = new wxButton(this, wxID_ANY, "Apply");
+    wxButton* cancelButton = new wxButton(this, wxID_CANCEL, "Cancel");
+
+    // Bind events to event handlers
+    modeChoice->Bind(wxEVT_CHOICE, &BatchEditDialog::OnModeChanged, this);
+    previewButton->Bind(wxEVT_BUTTON, &BatchEditDialog::OnPreview, this);
+    applyButton->Bind(wxEVT_BUTTON, &BatchEditDialog::OnApply, this);
+
+    // Set up the layout
+    wxFlexGridSizer* grid = new wxFlexGridSizer(2, 5, 10);
+    grid->AddGrowableCol(1);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Mode"), 0, wxALIGN_CENTER_VERTICAL);
+    grid->Add(modeChoice, 1, wxEXPAND);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Edit"), 0, wxALIGN_CENTER_VERTICAL);
+    grid->Add(fieldChoice, 1, wxEXPAND);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Find"), 0, wxALIGN_CENTER_VERTICAL);
+    grid->Add(findText, 1, wxEXPAND);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Replace with"), 0, wxALIGN_CENTER_VERTICAL);
+    grid->Add(replaceText, 1, wxEXPAND);
+
+    wxBoxSizer* hBox = new wxBoxSizer(wxHORIZONTAL);
+    hBox->Add(previewButton, 0, wxALL, 10);
+    hBox->Add(applyButton, 0, wxALL, 10);
+    hBox->Add(cancelButton, 0, wxALL, 10);
+
+    wxBoxSizer* vBox = new wxBoxSizer(wxVERTICAL);
+    vBox->Add(new wxStaticText(this, wxID_ANY, "Decks"), 0, wxLEFT | wxTOP, 10);
+    vBox->Add(deckList, 0, wxEXPAND | wxALL, 10);
+    vBox->Add(grid, 0, wxEXPAND | wxALL, 10);
+    vBox->Add(scriptText, 0, wxEXPAND | wxALL, 10);
+    vBox->Add(previewText, 1, wxEXPAND | wxALL, 10);
+    vBox->Add(hBox, 0, wxALIGN_CENTER);
+    SetSizer(vBox);
+    Centre();
+}
+
+/**
+ * @brief Getter for the batch prepared when the user pressed Apply.
+ * @return The prepared batch, not yet applied.
+ */
+EditBatch BatchEditDialog::getBatch() {
+    return batch;
+}
+
+/**
+ * @brief Event handler for changing the edit mode.
+ * Enables the inputs the selected mode uses.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void BatchEditDialog::OnModeChanged(wxCommandEvent& event) {
+    bool script = modeChoice->GetSelection() == 2;
+    fieldChoice->Enable(!script);
+    findText->Enable(!script);
+    replaceText->Enable(!script);
+    scriptText->Enable(script);
+}
+
+/**
+ * @brief Builds the transform from the inputs and runs it over the checked decks.
+ * @return False if the inputs are invalid, after telling the user why.
+ */
+bool BatchEditDialog::PrepareBatch() {
+    BatchTransform transform;
+    std::string error;
+    EditField fields[] = { EditField::Both, EditField::Question, EditField::Answer };
+    EditField field = fields[fieldChoice->GetSelection()];
+
+    switch (modeChoice->GetSelection()) {
+    case 0:
+        transform.addReplace(findText->GetValue().utf8_string(), replaceText->GetValue().utf8_string(), field);
+        break;
+    case 1:
+        if (!transform.addRegexReplace(findText->GetValue().utf8_string(), replaceText->GetValue().utf8_string(), field, error)) {
+            wxMessageBox(wxString::FromUTF8(error), "Error", wxOK | wxICON_ERROR, this);
+            return false;
+        }
+        break;
+    default:
+        if (!transform.parseScript(scriptText->GetValue().utf8_string(), error)) {
+            wxMessageBox(wxString::FromUTF8(error), "Error", wxOK | wxICON_ERROR, this);
+            return false;
+        }
+        break;
+    }
+
+    std::vector<std::shared_ptr<FlashCardDeck>> selected;
+    for (unsigned int i = 0; i < deckList->GetCount(); i++) {
+        if (deckList->IsChecked(i))
+            selected.push_back(decks[i]);
+    }
+
+    wxBusyCursor busy;
+    if (!EditBatch::prepare(selected, transform, batch, error)) {
+        wxMessageBox(wxString::FromUTF8(error), "Error", wxOK | wxICON_ERROR, this);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Event handler for the "Preview" button click.
+ * Shows what the edit would change without changing anything.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void BatchEditDialog::OnPreview(wxCommandEvent& event) {
+    if (!PrepareBatch())
+        return;
+
+    wxString summary = wxString::Format("%zu cards would change.\n\n", batch.size());
+    previewText->SetValue(summary + wxString::FromUTF8(batch.preview()));
+}
+
+/**
+ * @brief Event handler for the "Apply" button click.
+ * Prepares and validates the batch, then closes with OK status.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void BatchEditDialog::OnApply(wxCommandEvent& event) {
+    if (!PrepareBatch())
+        return;
+
+    std::string error;
+    if (!batch.validate(error)) {
+        wxMessageBox(wxString::FromUTF8(error), "Error", wxOK | wxICON_ERROR, this);
+        return;
+    }
+    EndModal(wxID_OK);
+}
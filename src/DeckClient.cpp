@@ -0,0 +1,442 @@
+/**
+ * @file DeckClient.cpp
+ * @brief Implementation of the deck server client.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckClient.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace DeckProtocol;
+
+/**
+ * @brief Constructor for the client, which starts out disconnected
+*/
+DeckClient::DeckClient() : fd(-1), nextRequestId(1)
+{
+}
+
+/**
+ * @brief Destructor, closes the connection
+*/
+DeckClient::~DeckClient()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+/**
+ * @brief Connects to a running deck server
+ * @param socketPath path of the server's Unix socket
+ * @returns true if the connection was made
+*/
+bool DeckClient::connectTo(const std::string& socketPath)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+        return false;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return false;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Whether the client currently has a connection to the server
+ * @returns true if connected
+*/
+bool DeckClient::isConnected() const
+{
+    return fd != -1;
+}
+
+/**
+ * @brief Getter for the message of the last failed request
+ * @returns the error message
+*/
+std::string DeckClient::getLastError() const
+{
+    return lastError;
+}
+
+/**
+ * @brief Fetches every deck in the server's library. The per-deck requests
+ * are pipelined so the whole library costs a single round trip.
+ * @returns a vector of all decks, empty on failure
+*/
+std::vector<std::shared_ptr<FlashCardDeck>> DeckClient::loadDecks()
+{
+    std::vector<std::shared_ptr<FlashCardDeck>> decks;
+    std::string response;
+    if (!request(LIST_DECKS, "", response))
+        return decks;
+
+    std::vector<std::string> names;
+    Reader reader(response);
+    uint32_t count = reader.getU32();
+    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+        names.push_back(reader.getString());
+        reader.getU32();
+    }
+
+    // Sends every request up front, then collects the replies in order
+    std::vector<uint32_t> requestIds;
+    for (const std::string& name : names) {
+        Writer writer;
+        writer.putString(name);
+        uint32_t requestId;
+        if (!sendRequest(GET_DECK, writer.data(), requestId))
+            return decks;
+        requestIds.push_back(requestId);
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        std::shared_ptr<FlashCardDeck> deck = receiveDeck(names[i], requestIds[i]);
+        if (deck)
+            decks.push_back(deck);
+        else if (!isConnected())
+            break;
+    }
+    return decks;
+}
+
+/**
+ * @brief Fetches a single deck from the server
+ * @param name the name of the deck
+ * @returns the deck, or a null pointer if it could not be fetched
+*/
+std::shared_ptr<FlashCardDeck> DeckClient::loadDeck(const std::string& name)
+{
+    Writer writer;
+    writer.putString(name);
+    uint32_t requestId;
+    if (!sendRequest(GET_DECK, writer.data(), requestId))
+        return nullptr;
+    return receiveDeck(name, requestId);
+}
+
+/**
+ * @brief Collects the frames of a GET_DECK reply and builds the deck. A
+ * large deck arrives over several frames, each giving the total card count
+ * and the cards it holds.
+ * @param name the name of the deck
+ * @param requestId id of the GET_DECK request
+ * @returns the deck, or a null pointer if it could not be fetched
+*/
+std::shared_ptr<FlashCardDeck> DeckClient::receiveDeck(const std::string& name, uint32_t requestId)
+{
+    std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(name);
+    std::string response;
+    uint32_t total = 0;
+    do {
+        if (!awaitReply(requestId, response))
+            return nullptr;
+        Reader reader(response);
+        total = reader.getU32();
+        uint32_t count = reader.getU32();
+        for (uint32_t i = 0; i < count; i++) {
+            std::string question = reader.getString();
+            std::string answer = reader.getString();
+            if (!reader.ok())
+                return nullptr;
+            deck->addCard(std::make_shared<FlashCard>(question, answer));
+        }
+        if (!reader.ok() || (count == 0 && deck->getCardCount() < total))
+            return nullptr;
+    } while (deck->getCardCount() < total);
+
+    dropNotifications(name);
+    return deck;
+}
+
+/**
+ * @brief Creates an empty deck on the server
+ * @param name the name of the new deck
+ * @returns true on success
+*/
+bool DeckClient::createDeck(const std::string& name)
+{
+    Writer writer;
+    writer.putString(name);
+    std::string response;
+    return request(CREATE_DECK, writer.data(), response);
+}
+
+/**
+ * @brief Adds a card to a deck on the server
+ * @param deckName the deck to add to
+ * @param question question for the card
+ * @param answer answer for the card
+ * @returns true on success
+*/
+bool DeckClient::addCard(const std::string& deckName, const std::string& question, const std::string& answer)
+{
+    Writer writer;
+    writer.putString(deckName);
+    writer.putString(question);
+    writer.putString(answer);
+    std::string response;
+    return request(ADD_CARD, writer.data(), response);
+}
+
+/**
+ * @brief Removes a card from a deck on the server
+ * @param deckName the deck to remove from
+ * @param index index of the card within the deck
+ * @returns true on success
+*/
+bool DeckClient::removeCard(const std::string& deckName, int index)
+{
+    Writer writer;
+    writer.putString(deckName);
+    writer.putU32(uint32_t(index));
+    std::string response;
+    return request(REMOVE_CARD, writer.data(), response);
+}
+
+/**
+ * @brief Asks the server to write its library to disk now
+ * @returns true on success
+*/
+bool DeckClient::save()
+{
+    std::string response;
+    return request(SAVE, "", response);
+}
+
+/**
+ * @brief Asks the server to push deck change notifications to this client
+ * @returns true on success
+*/
+bool DeckClient::subscribe()
+{
+    std::string response;
+    return request(SUBSCRIBE, "", response);
+}
+
+/**
+ * @brief Claims a diffuser pin for this station
+ * @param pin the pin to claim
+ * @returns true if this station now owns the pin
+*/
+bool DeckClient::acquirePin(int pin)
+{
+    Writer writer;
+    writer.putU32(uint32_t(pin));
+    std::string response;
+    return request(ACQUIRE_PIN, writer.data(), response);
+}
+
+/**
+ * @brief Gives up a pin, which the server turns off
+ * @param pin the pin to release
+ * @returns true on success
+*/
+bool DeckClient::releasePin(int pin)
+{
+    Writer writer;
+    writer.putU32(uint32_t(pin));
+    std::string response;
+    return request(RELEASE_PIN, writer.data(), response);
+}
+
+/**
+ * @brief Turns an owned pin on or off
+ * @param pin the pin to set
+ * @param on whether the diffuser should be on
+ * @returns true on success
+*/
+bool DeckClient::setPin(int pin, bool on)
+{
+    Writer writer;
+    writer.putU32(uint32_t(pin));
+    writer.putU8(on ? 1 : 0);
+    std::string response;
+    return request(SET_PIN, writer.data(), response);
+}
+
+/**
+ * @brief Collects notifications received so far without blocking
+ * @returns the queued notifications, oldest first
+*/
+std::vector<DeckNotification> DeckClient::pollNotifications()
+{
+    Frame frame;
+    while (isConnected() && readFrame(frame, false)) {
+        if (frame.opcode == NOTIFY)
+            queueNotification(frame);
+    }
+
+    std::vector<DeckNotification> result(notifications.begin(), notifications.end());
+    notifications.clear();
+    return result;
+}
+
+/**
+ * @brief Sends a request and waits for its reply
+ * @param opcode the request type
+ * @param payload encoded request fields
+ * @param response receives the reply payload
+ * @returns true if the server replied with success
+*/
+bool DeckClient::request(Opcode opcode, const std::string& payload, std::string& response)
+{
+    uint32_t requestId;
+    return sendRequest(opcode, payload, requestId) && awaitReply(requestId, response);
+}
+
+/**
+ * @brief Sends a request without waiting for its reply
+ * @param opcode the request type
+ * @param payload encoded request fields
+ * @param requestId receives the id to pass to awaitReply
+ * @returns true if the request was sent
+*/
+bool DeckClient::sendRequest(Opcode opcode, const std::string& payload, uint32_t& requestId)
+{
+    if (!isConnected()) {
+        lastError = "Not connected to deck server";
+        return false;
+    }
+
+    requestId = nextRequestId++;
+    std::string out;
+    appendFrame(out, opcode, requestId, payload);
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t written = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (written == -1 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            disconnect("Lost connection to deck server");
+            return false;
+        }
+        sent += size_t(written);
+    }
+    return true;
+}
+
+/**
+ * @brief Waits for the reply to a previously sent request. Replies arrive
+ * in request order, so earlier unclaimed replies are skipped.
+ * @param requestId id returned by sendRequest
+ * @param response receives the reply payload
+ * @returns true if the server replied with success
+*/
+bool DeckClient::awaitReply(uint32_t requestId, std::string& response)
+{
+    Frame frame;
+    while (isConnected() && readFrame(frame, true)) {
+        if (frame.opcode == NOTIFY) {
+            queueNotification(frame);
+            continue;
+        }
+        if (frame.requestId != requestId)
+            continue;
+
+        if (frame.opcode == REPLY_ERROR) {
+            Reader reader(frame.payload);
+            lastError = reader.getString();
+            return false;
+        }
+        response = frame.payload;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Reads the next frame from the server
+ * @param frame receives the frame
+ * @param block whether to wait for data when none is buffered
+ * @returns true if a frame was read
+*/
+bool DeckClient::readFrame(Frame& frame, bool block)
+{
+    while (true) {
+        size_t offset = 0;
+        bool error = false;
+        if (extractFrame(inBuffer, offset, frame, error)) {
+            inBuffer.erase(0, offset);
+            return true;
+        }
+        if (error) {
+            disconnect("Malformed reply from deck server");
+            return false;
+        }
+
+        char chunk[64 * 1024];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), block ? 0 : MSG_DONTWAIT);
+        if (received > 0) {
+            inBuffer.append(chunk, size_t(received));
+            continue;
+        }
+        if (received == -1 && errno == EINTR)
+            continue;
+        if (received == -1 && !block && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        disconnect("Lost connection to deck server");
+        return false;
+    }
+}
+
+/**
+ * @brief Decodes a notification frame onto the queue
+ * @param frame the notification
+*/
+void DeckClient::queueNotification(const Frame& frame)
+{
+    Reader reader(frame.payload);
+    DeckNotification notification;
+    notification.kind = NotifyKind(reader.getU8());
+    notification.deckName = reader.getString();
+    if (notification.kind == CARD_ADDED) {
+        notification.question = reader.getString();
+        notification.answer = reader.getString();
+    } else if (notification.kind == CARD_REMOVED) {
+        notification.index = int(reader.getU32());
+    }
+    if (reader.ok())
+        notifications.push_back(notification);
+}
+
+/**
+ * @brief Discards queued notifications about a deck that was just fetched.
+ * The server answers in order, so everything queued before the reply is
+ * already part of the fetched deck.
+ * @param deckName the deck that was fetched
+*/
+void DeckClient::dropNotifications(const std::string& deckName)
+{
+    for (auto it = notifications.begin(); it != notifications.end();) {
+        if (it->deckName == deckName)
+            it = notifications.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * @brief Closes the connection after an error
+ * @param reason message to report through getLastError
+*/
+void DeckClient::disconnect(const std::string& reason)
+{
+    lastError = reason;
+    if (fd != -1)
+        close(fd);
+    fd = -1;
+    inBuffer.clear();
+}
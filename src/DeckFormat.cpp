@@ -0,0 +1,39 @@
+/**
+ * @file DeckFormat.cpp
+ * @brief Checks deck names and card text against the deck file format.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckFormat.h"
+
+/**
+ * @brief Checks that a name can be used as a deck file inside a library.
+ * Hidden names are refused as well, since they are skipped when loading
+ * and include the sync manifest and media directory.
+ * @param name the proposed deck name
+ * @returns true if the name is a single visible path component
+*/
+bool isValidDeckName(const std::string& name)
+{
+    return !name.empty() && name[0] != '.' && name.find_first_of("/\\") == std::string::npos && name.find('\0') == std::string::npos;
+}
+
+/**
+ * @brief Checks that a card survives being written as a "question:answer" line
+ * @param question the card's question
+ * @param answer the card's answer
+ * @param problem receives what is wrong with the card, phrased to follow "has"
+ * @returns true if the card reloads unchanged
+*/
+bool isValidCardText(const std::string& question, const std::string& answer, std::string& problem)
+{
+    if (question.empty() || answer.empty())
+        problem = "an empty question or answer";
+    else if (question.find(':') != std::string::npos)
+        problem = "a colon in its question";
+    else if (question.find_first_of("\r\n") != std::string::npos || answer.find_first_of("\r\n") != std::string::npos)
+        problem = "a line break";
+    else
+        return true;
+    return false;
+}
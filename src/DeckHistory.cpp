@@ -0,0 +1,149 @@
+/**
+ * @file DeckHistory.cpp
+ * @brief Implementation of the DeckHistory class.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckHistory.h"
+
+/**
+ * @brief Constructor for the history
+ * @param limit the most undo steps to keep
+ * @param nodeBudget the most deck nodes the kept steps may hold apart from
+ * the current decks
+*/
+DeckHistory::DeckHistory(size_t limit, size_t nodeBudget) : limit(limit), nodeBudget(nodeBudget)
+{
+}
+
+/**
+ * @brief Starts recording an operation by taking O(1) snapshots of the
+ * decks it may change
+ * @param description name of the operation, shown on the undo button
+ * @param decks the decks the operation may change
+ * @returns the entry to pass to commit once the operation is done
+*/
+HistoryEntry DeckHistory::begin(const std::string& description, const std::vector<std::shared_ptr<FlashCardDeck>>& decks)
+{
+    HistoryEntry entry;
+    entry.description = description;
+    for (std::shared_ptr<FlashCardDeck> deck : decks)
+        entry.changes.push_back({deck, deck->snapshot(), FlashCardDeck::Version()});
+    return entry;
+}
+
+/**
+ * @brief Finishes recording an operation. Decks the operation left as they
+ * were are dropped from the entry, and nothing is recorded if none changed.
+ * The entry is charged the nodes its before and after versions do not share.
+ * @param entry the entry returned by begin
+ * @returns true if the operation was recorded
+*/
+bool DeckHistory::commit(HistoryEntry entry)
+{
+    std::vector<DeckChange> changed;
+    for (DeckChange& change : entry.changes) {
+        change.after = change.deck->snapshot();
+        if (!change.after.sameVersion(change.before))
+            changed.push_back(change);
+    }
+    if (changed.empty())
+        return false;
+
+    entry.changes = changed;
+    entry.nodes = 0;
+    for (const DeckChange& change : changed)
+        entry.nodes += change.before.countNodesNotIn(change.after) + change.after.countNodesNotIn(change.before);
+
+    for (const HistoryEntry& dropped : redoStack)
+        nodes -= dropped.nodes;
+    redoStack.clear();
+    undoStack.push_back(entry);
+    nodes += entry.nodes;
+    while (undoStack.size() > 1 && (undoStack.size() > limit || nodes > nodeBudget)) {
+        nodes -= undoStack.front().nodes;
+        undoStack.pop_front();
+    }
+    return true;
+}
+
+/**
+ * @brief Forgets every recorded operation, used when the decks are
+ * replaced wholesale
+*/
+void DeckHistory::clear()
+{
+    undoStack.clear();
+    redoStack.clear();
+    nodes = 0;
+}
+
+/**
+ * @brief Whether there is an operation to undo
+ * @returns true if undo would do something
+*/
+bool DeckHistory::canUndo() const
+{
+    return !undoStack.empty();
+}
+
+/**
+ * @brief Whether there is an operation to redo
+ * @returns true if redo would do something
+*/
+bool DeckHistory::canRedo() const
+{
+    return !redoStack.empty();
+}
+
+/**
+ * @brief Gets the name of the operation undo would revert
+ * @returns the description, or an empty string
+*/
+std::string DeckHistory::undoDescription() const
+{
+    return undoStack.empty() ? "" : undoStack.back().description;
+}
+
+/**
+ * @brief Gets the name of the operation redo would reapply
+ * @returns the description, or an empty string
+*/
+std::string DeckHistory::redoDescription() const
+{
+    return redoStack.empty() ? "" : redoStack.back().description;
+}
+
+/**
+ * @brief Restores every deck of the latest operation to its earlier version
+ * @returns false if there was nothing to undo
+*/
+bool DeckHistory::undo()
+{
+    if (undoStack.empty())
+        return false;
+
+    HistoryEntry entry = undoStack.back();
+    undoStack.pop_back();
+    for (DeckChange& change : entry.changes)
+        change.deck->restore(change.before);
+    redoStack.push_back(entry);
+    return true;
+}
+
+/**
+ * @brief Reapplies the most recently undone operation
+ * @returns false if there was nothing to redo
+*/
+bool DeckHistory::redo()
+{
+    if (redoStack.empty())
+        return false;
+
+    HistoryEntry entry = redoStack.back();
+    redoStack.pop_back();
+    for (DeckChange& change : entry.changes)
+        change.deck->restore(change.after);
+    undoStack.push_back(entry);
+    return true;
+}
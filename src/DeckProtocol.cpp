@@ -0,0 +1,180 @@
+/**
+ * @file DeckProtocol.cpp
+ * @brief Encoding and decoding of deck server frames.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckProtocol.h"
+
+namespace DeckProtocol {
+
+/**
+ * @brief Reads a big endian u32 from the given bytes
+ * @param bytes pointer to at least four bytes
+ * @returns the decoded value
+*/
+static uint32_t readU32(const char* bytes)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(bytes);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+/**
+ * @brief Appends a big endian u32 to the given buffer
+ * @param out buffer to append to
+ * @param value value to encode
+*/
+static void writeU32(std::string& out, uint32_t value)
+{
+    out.push_back(char((value >> 24) & 0xFF));
+    out.push_back(char((value >> 16) & 0xFF));
+    out.push_back(char((value >> 8) & 0xFF));
+    out.push_back(char(value & 0xFF));
+}
+
+/**
+ * @brief Appends a single byte to the payload
+ * @param value byte to append
+*/
+void Writer::putU8(uint8_t value)
+{
+    buffer.push_back(char(value));
+}
+
+/**
+ * @brief Appends a u32 to the payload
+ * @param value value to append
+*/
+void Writer::putU32(uint32_t value)
+{
+    writeU32(buffer, value);
+}
+
+/**
+ * @brief Appends a length prefixed string to the payload
+ * @param value string to append
+*/
+void Writer::putString(const std::string& value)
+{
+    writeU32(buffer, uint32_t(value.size()));
+    buffer += value;
+}
+
+/**
+ * @brief Getter for the encoded payload
+ * @returns the bytes written so far
+*/
+const std::string& Writer::data() const
+{
+    return buffer;
+}
+
+/**
+ * @brief Constructor for the reader
+ * @param data payload to read from, must outlive the reader
+*/
+Reader::Reader(const std::string& data) : data(data), pos(0), valid(true)
+{
+}
+
+/**
+ * @brief Reads a single byte
+ * @returns the byte, or 0 if the payload is exhausted
+*/
+uint8_t Reader::getU8()
+{
+    if (!valid || pos + 1 > data.size()) {
+        valid = false;
+        return 0;
+    }
+    return uint8_t(data[pos++]);
+}
+
+/**
+ * @brief Reads a u32
+ * @returns the value, or 0 if the payload is exhausted
+*/
+uint32_t Reader::getU32()
+{
+    if (!valid || pos + 4 > data.size()) {
+        valid = false;
+        return 0;
+    }
+    uint32_t value = readU32(data.data() + pos);
+    pos += 4;
+    return value;
+}
+
+/**
+ * @brief Reads a length prefixed string
+ * @returns the string, or an empty string if the payload is exhausted
+*/
+std::string Reader::getString()
+{
+    uint32_t length = getU32();
+    if (!valid || pos + length > data.size()) {
+        valid = false;
+        return "";
+    }
+    std::string value = data.substr(pos, length);
+    pos += length;
+    return value;
+}
+
+/**
+ * @brief Whether every read so far was within the payload
+ * @returns false if any read ran past the end
+*/
+bool Reader::ok() const
+{
+    return valid;
+}
+
+/**
+ * @brief Encodes a frame onto the end of an output buffer
+ * @param out buffer to append to
+ * @param opcode the frame's opcode
+ * @param requestId id used to match replies to requests
+ * @param payload encoded fields of the frame
+*/
+void appendFrame(std::string& out, uint8_t opcode, uint32_t requestId, const std::string& payload)
+{
+    writeU32(out, uint32_t(HEADER_SIZE - 4 + payload.size()));
+    out.push_back(char(opcode));
+    writeU32(out, requestId);
+    out += payload;
+}
+
+/**
+ * @brief Decodes the next complete frame in a buffer, if there is one.
+ * Frames are read starting at offset so that many pipelined frames can be
+ * consumed before the caller compacts the buffer once.
+ * @param in buffer of received bytes
+ * @param offset position to read from, advanced past the frame on success
+ * @param frame receives the decoded frame
+ * @param error set when the buffer holds an oversized or malformed frame
+ * @returns true if a frame was decoded
+*/
+bool extractFrame(std::string& in, size_t& offset, Frame& frame, bool& error)
+{
+    error = false;
+    if (in.size() - offset < 4)
+        return false;
+
+    uint32_t length = readU32(in.data() + offset);
+    if (length < HEADER_SIZE - 4 || length > MAX_FRAME_SIZE) {
+        error = true;
+        return false;
+    }
+    if (in.size() - offset < 4 + size_t(length))
+        return false;
+
+    const char* start = in.data() + offset + 4;
+    frame.opcode = uint8_t(start[0]);
+    frame.requestId = readU32(start + 1);
+    frame.payload.assign(start + 5, length - 5);
+    offset += 4 + length;
+    return true;
+}
+
+}
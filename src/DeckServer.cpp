@@ -0,0 +1,672 @@
+/**
+ * @file DeckServer.cpp
+ * @brief Event loop, request handling and pin arbitration for the deck server.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckServer.h"
+#include "../include/FileManagement.h"
+#include "../include/DeckFormat.h"
+#include "../include/AromaControl.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace DeckProtocol;
+
+// How long dirty decks may stay unsaved, so bursts of edits share one write
+static const std::chrono::milliseconds SAVE_INTERVAL(1000);
+
+// Upper bound on events handled per wakeup of the loop
+static const int MAX_EVENTS = 256;
+
+// Unsent replies a client may build up before the server stops handling its requests
+static const size_t MAX_CLIENT_BACKLOG = MAX_FRAME_SIZE;
+
+// Unsent output a subscriber may build up before it is treated as stuck and disconnected
+static const size_t MAX_SUBSCRIBER_BACKLOG = 4 * MAX_FRAME_SIZE;
+
+// The only pins stations may claim, anything else could drive an arbitrary GPIO line
+static const int AROMA_PINS[] = { PIN_ONE, PIN_TWO, PIN_THREE };
+
+/**
+ * @brief Checks that a pin drives one of the aroma diffusers
+ * @param pin the pin a client asked for
+ * @returns true if the pin is in AROMA_PINS
+*/
+static bool isAromaPin(int pin)
+{
+    for (int aromaPin : AROMA_PINS) {
+        if (pin == aromaPin)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Puts a file descriptor into non-blocking mode
+ * @param fd descriptor to change
+ * @returns true on success
+*/
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+/**
+ * @brief Constructor for the deck server
+ * @param socketPath filesystem path of the Unix socket to listen on
+*/
+DeckServer::DeckServer(const std::string& socketPath)
+    : socketPath(socketPath), listenFd(-1), epollFd(-1), signalFd(-1), running(false), dirty(false), pinWorkerStopping(false)
+{
+}
+
+/**
+ * @brief Destructor, saves outstanding changes and releases every pin
+*/
+DeckServer::~DeckServer()
+{
+    saveIfDirty(true);
+    for (auto& entry : connections)
+        close(entry.first);
+    while (!pinOwners.empty())
+        releasePin(pinOwners.begin()->first);
+
+    // Lets the worker finish turning the diffusers off before exiting
+    if (pinWorker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(pinMutex);
+            pinWorkerStopping = true;
+        }
+        pinWake.notify_one();
+        pinWorker.join();
+    }
+    if (signalFd != -1)
+        close(signalFd);
+    if (epollFd != -1)
+        close(epollFd);
+    if (listenFd != -1) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+}
+
+/**
+ * @brief Loads the library and starts listening on the socket
+ * @returns true if the server is ready to run
+*/
+bool DeckServer::start()
+{
+    // Loads the decks this server now owns
+    std::filesystem::create_directories("decks");
+    decks = loadDecks();
+    for (std::shared_ptr<FlashCardDeck> deck : decks)
+        deckIndex[deck->getName()] = deck;
+
+    // Blocks SIGINT and SIGTERM before any thread starts, so they are only
+    // ever read from the signal descriptor in the event loop
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd == -1) {
+        std::cerr << "Error creating signal descriptor: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Sets up every diffuser once, in the background
+    pinWorker = std::thread(&DeckServer::runPinActions, this);
+    for (int pin : AROMA_PINS)
+        queuePinAction(pin, PIN_INIT);
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    // Removes a stale socket left behind by a previous run
+    unlink(socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1 || !setNonBlocking(listenFd)) {
+        std::cerr << "Error creating socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || listen(listenFd, SOMAXCONN) == -1) {
+        std::cerr << "Error listening on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    epollFd = epoll_create1(0);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_event signalEvent{};
+    signalEvent.events = EPOLLIN;
+    signalEvent.data.fd = signalFd;
+    if (epollFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == -1
+        || epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &signalEvent) == -1) {
+        std::cerr << "Error creating event loop: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    lastSave = std::chrono::steady_clock::now();
+    running = true;
+    return true;
+}
+
+/**
+ * @brief Runs the event loop until SIGINT or SIGTERM arrives
+*/
+void DeckServer::run()
+{
+    epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        int timeout = dirty ? int(SAVE_INTERVAL.count()) : -1;
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Event loop failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptClients();
+                continue;
+            }
+            if (fd == signalFd) {
+                signalfd_siginfo signal;
+                if (read(signalFd, &signal, sizeof(signal)) == sizeof(signal))
+                    running = false;
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end() || it->second.closing)
+                continue;
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                closeClient(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLIN)
+                readClient(it->second);
+            if (events[i].events & EPOLLOUT)
+                pendingWrites.insert(fd);
+        }
+
+        // Replies and notifications produced by this batch go out together, and
+        // a client whose backlog drains may produce more by resuming its requests
+        while (!pendingWrites.empty()) {
+            std::set<int> writes;
+            writes.swap(pendingWrites);
+            for (int fd : writes) {
+                auto it = connections.find(fd);
+                if (it != connections.end() && !it->second.closing)
+                    flushClient(it->second);
+            }
+        }
+
+        for (int fd : pendingCloses) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections.erase(fd);
+        }
+        pendingCloses.clear();
+
+        saveIfDirty(false);
+    }
+}
+
+/**
+ * @brief Accepts every pending connection on the listening socket
+*/
+void DeckServer::acceptClients()
+{
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd == -1)
+            return;
+        if (!setNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            close(fd);
+            continue;
+        }
+        connections[fd].fd = fd;
+        connections[fd].events = EPOLLIN;
+    }
+}
+
+/**
+ * @brief Reads everything available from a client and handles each complete frame
+ * @param connection the client to read from
+*/
+void DeckServer::readClient(Connection& connection)
+{
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t received = recv(connection.fd, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            connection.inBuffer.append(chunk, size_t(received));
+            continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            closeClient(connection.fd);
+            return;
+        }
+        if (errno != EINTR)
+            break;
+    }
+    handleFrames(connection);
+}
+
+/**
+ * @brief Handles every complete frame a client has sent, then drops the
+ * consumed bytes once. Stops early while the client has more unsent
+ * replies than MAX_CLIENT_BACKLOG, so a client that sends requests without
+ * reading the replies cannot make the server buffer without limit. The
+ * remaining frames are handled once the backlog drains.
+ * @param connection the client whose frames to handle
+*/
+void DeckServer::handleFrames(Connection& connection)
+{
+    size_t offset = 0;
+    Frame frame;
+    bool error = false;
+    while (!connection.closing && connection.outBuffer.size() <= MAX_CLIENT_BACKLOG && extractFrame(connection.inBuffer, offset, frame, error))
+        handleFrame(connection, frame);
+    if (error) {
+        closeClient(connection.fd);
+        return;
+    }
+    connection.inBuffer.erase(0, offset);
+}
+
+/**
+ * @brief Writes as much buffered output as the socket accepts, resumes the
+ * client's requests if that brought its backlog back under the limit, and
+ * updates which events the loop waits for
+ * @param connection the client to write to
+*/
+void DeckServer::flushClient(Connection& connection)
+{
+    size_t sent = 0;
+    while (sent < connection.outBuffer.size()) {
+        ssize_t written = send(connection.fd, connection.outBuffer.data() + sent, connection.outBuffer.size() - sent, MSG_NOSIGNAL);
+        if (written > 0) {
+            sent += size_t(written);
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeClient(connection.fd);
+            return;
+        }
+        break;
+    }
+    bool backlogged = connection.outBuffer.size() > MAX_CLIENT_BACKLOG;
+    connection.outBuffer.erase(0, sent);
+    if (backlogged && connection.outBuffer.size() <= MAX_CLIENT_BACKLOG)
+        handleFrames(connection);
+    if (!connection.closing)
+        updateEvents(connection);
+}
+
+/**
+ * @brief Waits for writability while output is left over, and stops
+ * reading from a client whose backlog is over the limit until it drains
+ * @param connection the client to update
+*/
+void DeckServer::updateEvents(Connection& connection)
+{
+    uint32_t events = 0;
+    if (connection.outBuffer.size() <= MAX_CLIENT_BACKLOG)
+        events |= EPOLLIN;
+    if (!connection.outBuffer.empty())
+        events |= EPOLLOUT;
+    if (events != connection.events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+/**
+ * @brief Disconnects a client at the end of the current batch, freeing its pins
+ * @param fd descriptor of the client
+*/
+void DeckServer::closeClient(int fd)
+{
+    auto it = connections.find(fd);
+    if (it == connections.end() || it->second.closing)
+        return;
+
+    for (int pin : it->second.pins)
+        releasePin(pin);
+    it->second.pins.clear();
+    it->second.closing = true;
+    pendingCloses.push_back(fd);
+}
+
+/**
+ * @brief Queues a successful reply to a request
+ * @param connection client that sent the request
+ * @param requestId id of the request being answered
+ * @param payload encoded reply fields
+*/
+void DeckServer::reply(Connection& connection, uint32_t requestId, const std::string& payload)
+{
+    appendFrame(connection.outBuffer, REPLY_OK, requestId, payload);
+    pendingWrites.insert(connection.fd);
+}
+
+/**
+ * @brief Queues an error reply to a request
+ * @param connection client that sent the request
+ * @param requestId id of the request being answered
+ * @param message description of the error
+*/
+void DeckServer::replyError(Connection& connection, uint32_t requestId, const std::string& message)
+{
+    Writer writer;
+    writer.putString(message);
+    appendFrame(connection.outBuffer, REPLY_ERROR, requestId, writer.data());
+    pendingWrites.insert(connection.fd);
+}
+
+/**
+ * @brief Pushes a change to every subscribed client, including the one that
+ * made it, so that all of them apply changes in the server's order.
+ * Subscribers that have stopped reading are disconnected rather than
+ * buffered for without limit.
+ * @param notification encoded notification fields
+*/
+void DeckServer::notifySubscribers(const std::string& notification)
+{
+    for (auto& entry : connections) {
+        Connection& connection = entry.second;
+        if (!connection.subscribed || connection.closing)
+            continue;
+        if (connection.outBuffer.size() > MAX_SUBSCRIBER_BACKLOG) {
+            closeClient(connection.fd);
+            continue;
+        }
+        appendFrame(connection.outBuffer, NOTIFY, 0, notification);
+        pendingWrites.insert(connection.fd);
+    }
+}
+
+/**
+ * @brief Turns a pin off and gives up its ownership
+ * @param pin the pin to release
+*/
+void DeckServer::releasePin(int pin)
+{
+    if (pinOwners.erase(pin) > 0)
+        queuePinAction(pin, PIN_OFF);
+}
+
+/**
+ * @brief Hands a diffuser command to the pin worker
+ * @param pin the pin to drive
+ * @param action what to do with the pin
+*/
+void DeckServer::queuePinAction(int pin, PinAction action)
+{
+    {
+        std::lock_guard<std::mutex> lock(pinMutex);
+        pinActions.emplace_back(pin, action);
+    }
+    pinWake.notify_one();
+}
+
+/**
+ * @brief Body of the pin worker, runs queued diffuser commands in order
+ * until the server is destroyed and the queue is empty
+*/
+void DeckServer::runPinActions()
+{
+    while (true) {
+        std::pair<int, PinAction> next;
+        {
+            std::unique_lock<std::mutex> lock(pinMutex);
+            pinWake.wait(lock, [this]() { return pinWorkerStopping || !pinActions.empty(); });
+            if (pinActions.empty())
+                return;
+            next = pinActions.front();
+            pinActions.pop_front();
+        }
+
+        if (next.second == PIN_INIT)
+            initPin(next.first);
+        else if (next.second == PIN_ON)
+            turnOnPin(next.first);
+        else
+            turnOffPin(next.first);
+    }
+}
+
+/**
+ * @brief Writes the library to disk if it changed, at most once per save interval
+ * @param force saves immediately regardless of the interval
+*/
+void DeckServer::saveIfDirty(bool force)
+{
+    if (!dirty)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - lastSave < SAVE_INTERVAL)
+        return;
+    saveDecks(decks);
+    dirty = false;
+    lastSave = now;
+}
+
+/**
+ * @brief Finds a deck by name
+ * @param name the name of the deck
+ * @returns the deck, or a null pointer if not found
+*/
+std::shared_ptr<FlashCardDeck> DeckServer::findDeck(const std::string& name)
+{
+    auto it = deckIndex.find(name);
+    return it == deckIndex.end() ? nullptr : it->second;
+}
+
+/**
+ * @brief Carries out a single request and queues its reply
+ * @param connection client that sent the request
+ * @param frame the decoded request
+*/
+void DeckServer::handleFrame(Connection& connection, const Frame& frame)
+{
+    Reader reader(frame.payload);
+    Writer writer;
+
+    switch (frame.opcode) {
+    case LIST_DECKS: {
+        writer.putU32(uint32_t(decks.size()));
+        for (std::shared_ptr<FlashCardDeck> deck : decks) {
+            writer.putString(deck->getName());
+            writer.putU32(uint32_t(deck->getCardCount()));
+        }
+        reply(connection, frame.requestId, writer.data());
+        return;
+    }
+    case GET_DECK: {
+        std::shared_ptr<FlashCardDeck> deck = findDeck(reader.getString());
+        if (!reader.ok() || !deck) {
+            replyError(connection, frame.requestId, "No such deck");
+            return;
+        }
+
+        // Splits the cards over as many frames as it takes to stay within MAX_FRAME_SIZE
+        std::vector<std::shared_ptr<FlashCard>> cards = deck->getCards();
+        std::vector<std::string> parts;
+        Writer part;
+        uint32_t partCards = 0;
+        auto finishPart = [&]() {
+            Writer header;
+            header.putU32(uint32_t(cards.size()));
+            header.putU32(partCards);
+            parts.push_back(header.data() + part.data());
+            part = Writer();
+            partCards = 0;
+        };
+        for (std::shared_ptr<FlashCard> card : cards) {
+            size_t cardSize = 8 + card->getQuestion().size() + card->getAnswer().size();
+            if (8 + cardSize > MAX_PAYLOAD_SIZE) {
+                replyError(connection, frame.requestId, "Deck holds a card too large to send");
+                return;
+            }
+            if (8 + part.data().size() + cardSize > MAX_PAYLOAD_SIZE)
+                finishPart();
+            part.putString(card->getQuestion());
+            part.putString(card->getAnswer());
+            partCards++;
+        }
+        finishPart();
+        for (const std::string& payload : parts)
+            reply(connection, frame.requestId, payload);
+        return;
+    }
+    case CREATE_DECK: {
+        std::string name = reader.getString();
+        if (!reader.ok() || !isValidDeckName(name)) {
+            replyError(connection, frame.requestId, "Invalid deck name");
+            return;
+        }
+        if (findDeck(name)) {
+            replyError(connection, frame.requestId, "Deck Already Exists");
+            return;
+        }
+        std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(name);
+        decks.push_back(deck);
+        deckIndex[name] = deck;
+        dirty = true;
+        reply(connection, frame.requestId, "");
+        writer.putU8(DECK_CREATED);
+        writer.putString(name);
+        notifySubscribers(writer.data());
+        return;
+    }
+    case ADD_CARD: {
+        std::shared_ptr<FlashCardDeck> deck = findDeck(reader.getString());
+        std::string question = reader.getString();
+        std::string answer = reader.getString();
+        std::string problem;
+        if (!reader.ok() || !deck) {
+            replyError(connection, frame.requestId, "No such deck");
+            return;
+        }
+        if (!isValidCardText(question, answer, problem)) {
+            replyError(connection, frame.requestId, "Invalid card, it has " + problem);
+            return;
+        }
+        deck->addCard(std::make_shared<FlashCard>(question, answer));
+        dirty = true;
+        reply(connection, frame.requestId, "");
+        writer.putU8(CARD_ADDED);
+        writer.putString(deck->getName());
+        writer.putString(question);
+        writer.putString(answer);
+        notifySubscribers(writer.data());
+        return;
+    }
+    case REMOVE_CARD: {
+        std::shared_ptr<FlashCardDeck> deck = findDeck(reader.getString());
+        uint32_t index = reader.getU32();
+        if (!reader.ok() || !deck || index >= deck->getCardCount()) {
+            replyError(connection, frame.requestId, "No such card");
+            return;
+        }
+        deck->removeCardAt(int(index));
+        dirty = true;
+        reply(connection, frame.requestId, "");
+        writer.putU8(CARD_REMOVED);
+        writer.putString(deck->getName());
+        writer.putU32(index);
+        notifySubscribers(writer.data());
+        return;
+    }
+    case SAVE:
+        saveIfDirty(true);
+        reply(connection, frame.requestId, "");
+        return;
+    case SUBSCRIBE:
+        connection.subscribed = true;
+        reply(connection, frame.requestId, "");
+        return;
+    case ACQUIRE_PIN: {
+        int pin = int(reader.getU32());
+        if (!reader.ok()) {
+            replyError(connection, frame.requestId, "Malformed request");
+            return;
+        }
+        if (!isAromaPin(pin)) {
+            replyError(connection, frame.requestId, "No such aroma");
+            return;
+        }
+        auto owner = pinOwners.find(pin);
+        if (owner != pinOwners.end() && owner->second != connection.fd) {
+            replyError(connection, frame.requestId, "Aroma in use by another station");
+            return;
+        }
+        pinOwners[pin] = connection.fd;
+        connection.pins.insert(pin);
+        reply(connection, frame.requestId, "");
+        return;
+    }
+    case RELEASE_PIN: {
+        int pin = int(reader.getU32());
+        if (reader.ok() && connection.pins.erase(pin) > 0)
+            releasePin(pin);
+        reply(connection, frame.requestId, "");
+        return;
+    }
+    case SET_PIN: {
+        int pin = int(reader.getU32());
+        bool on = reader.getU8() != 0;
+        if (!reader.ok() || connection.pins.count(pin) == 0) {
+            replyError(connection, frame.requestId, "Pin not acquired");
+            return;
+        }
+        queuePinAction(pin, on ? PIN_ON : PIN_OFF);
+        reply(connection, frame.requestId, "");
+        return;
+    }
+    default:
+        replyError(connection, frame.requestId, "Unknown request");
+        return;
+    }
+}
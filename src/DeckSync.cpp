@@ -0,0 +1,597 @@
+/**
+ * @file DeckSync.cpp
+ * @brief Hashes decks into a Merkle-style manifest, and merges libraries
+ * by transferring only the cards the target is missing.
+ * @author Ben Namo
+ */
+
+#include "../include/DeckSync.h"
+#include "../include/FileManagement.h"
+#include "../include/DeckFormat.h"
+#include "../include/Hashing.h"
+#include "../include/MediaStore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+
+// Coarsest modification time resolution of the filesystems a library may
+// live on, two seconds on the FAT formatted sticks used to carry libraries
+static const std::chrono::seconds TIMESTAMP_RESOLUTION(2);
+
+/**
+ * @brief Hashes a string with 64 bit FNV-1a
+ * @param text the string to hash
+ * @param hash the starting hash, used to chain several strings
+ * @returns the hash
+*/
+static uint64_t hashString(const std::string& text, uint64_t hash = 0xCBF29CE484222325ULL)
+{
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Combines two child hashes into their parent's hash
+ * @param left hash of the left child
+ * @param right hash of the right child
+ * @returns the parent hash
+*/
+static uint64_t combine(uint64_t left, uint64_t right)
+{
+    return mix(left * 0x9E3779B97F4A7C15ULL ^ right);
+}
+
+/**
+ * @brief Reduces a list of hashes to the root of a binary Merkle tree
+ * @param level the leaf hashes, consumed by the reduction
+ * @returns the root hash, or 0 for an empty list
+*/
+static uint64_t merkleRoot(std::vector<uint64_t> level)
+{
+    if (level.empty())
+        return 0;
+
+    // Pairs up neighbours until one hash is left, an odd last hash moves up unchanged
+    while (level.size() > 1) {
+        size_t next = 0;
+        for (size_t i = 0; i < level.size(); i += 2)
+            level[next++] = i + 1 < level.size() ? combine(level[i], level[i + 1]) : level[i];
+        level.resize(next);
+    }
+    return level[0];
+}
+
+/**
+ * @brief Records the size and modification time of a deck file, used to
+ * tell whether the manifest entry is still current
+ * @param path the deck file
+ * @param digest the entry to update
+*/
+static void statDeckFile(const std::filesystem::path& path, DeckDigest& digest)
+{
+    std::error_code error;
+    digest.fileSize = std::filesystem::file_size(path, error);
+    digest.modified = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+}
+
+/**
+ * @brief Hashes the content of a single card
+ * @param question the card's question
+ * @param answer the card's answer
+ * @returns the content hash
+*/
+uint64_t hashCard(const std::string& question, const std::string& answer)
+{
+    // The separator keeps "a:bc" and "ab:c" apart
+    return mix(hashString(answer, hashString(question) ^ 0xFF));
+}
+
+/**
+ * @brief Hashes every card in a version of a deck
+ * @param version the version to hash
+ * @returns the card hashes, sorted
+*/
+static std::vector<uint64_t> hashVersion(const FlashCardDeck::Version& version)
+{
+    std::vector<uint64_t> hashes;
+    version.forEach([&](const std::shared_ptr<FlashCard>& card) {
+        hashes.push_back(hashCard(card->getQuestion(), card->getAnswer()));
+    });
+    std::sort(hashes.begin(), hashes.end());
+    return hashes;
+}
+
+/**
+ * @brief Hashes every card in a deck
+ * @param deck the deck to hash
+ * @returns the card hashes, sorted
+*/
+std::vector<uint64_t> hashCards(const std::shared_ptr<FlashCardDeck> deck)
+{
+    return hashVersion(deck->snapshot());
+}
+
+/**
+ * @brief Hashes a deck as a whole, as the Merkle root of its sorted card hashes
+ * @param deck the deck to hash
+ * @returns the deck's digest, without file information
+*/
+DeckDigest digestDeck(const std::shared_ptr<FlashCardDeck> deck)
+{
+    DeckDigest digest;
+    digest.name = deck->getName();
+    digest.digest = combine(hashString(digest.name), merkleRoot(hashCards(deck)));
+    return digest;
+}
+
+/**
+ * @brief Recomputes the library digest from the digests of its decks
+ * @param manifest the manifest to update
+*/
+void updateLibraryDigest(LibraryManifest& manifest)
+{
+    std::vector<uint64_t> deckDigests;
+    for (const auto& entry : manifest.decks)
+        deckDigests.push_back(entry.second.digest);
+    manifest.digest = merkleRoot(deckDigests);
+}
+
+/**
+ * @brief Reads a manifest file
+ * @param path the manifest file
+ * @param manifest receives the manifest
+ * @returns false if the file is missing or malformed
+*/
+bool readManifest(const std::string& path, LibraryManifest& manifest)
+{
+    std::ifstream input(path);
+    std::string header;
+    if (!input || !std::getline(input, header) || header != "aroma-manifest 2")
+        return false;
+    if (!(input >> std::hex >> manifest.digest))
+        return false;
+
+    // Each deck is a single line of file information, digest and name
+    DeckDigest digest;
+    while (input >> std::dec >> digest.fileSize >> digest.modified >> std::hex >> digest.digest) {
+        input.get();
+        if (!std::getline(input, digest.name))
+            return false;
+        manifest.decks[digest.name] = digest;
+    }
+    return input.eof();
+}
+
+/**
+ * @brief Writes a manifest file
+ * @param path the manifest file
+ * @param manifest the manifest to write
+ * @returns true if the file was written
+*/
+bool writeManifest(const std::string& path, const LibraryManifest& manifest)
+{
+    std::ofstream output(path);
+    if (!output)
+        return false;
+
+    output << "aroma-manifest 2\n" << std::hex << manifest.digest << "\n";
+    for (const auto& entry : manifest.decks) {
+        const DeckDigest& digest = entry.second;
+        output << std::dec << digest.fileSize << " " << digest.modified << " " << std::hex << digest.digest << " " << digest.name << "\n";
+    }
+    return bool(output);
+}
+
+/**
+ * @brief Brings a library's manifest up to date with its deck files. Only
+ * decks whose size or modification time changed are read and rehashed. A
+ * deck modified within the timestamp resolution of when the manifest was
+ * written is rehashed too, since an edit that kept its size could have
+ * landed in the same clock tick as the recorded time.
+ * @param directory the library directory
+ * @returns the current manifest
+*/
+LibraryManifest refreshManifest(const std::string& directory)
+{
+    std::filesystem::path manifestPath = std::filesystem::path(directory) / MANIFEST_FILE;
+    LibraryManifest stored;
+    readManifest(manifestPath.string(), stored);
+    std::error_code error;
+    std::filesystem::file_time_type manifestWritten = std::filesystem::last_write_time(manifestPath, error);
+
+    LibraryManifest current;
+    bool changed = false;
+    for (const auto& directoryItem : std::filesystem::directory_iterator(directory)) {
+        std::string deckName = directoryItem.path().filename().string();
+        if (!directoryItem.is_regular_file() || deckName[0] == '.')
+            continue;
+
+        DeckDigest stat;
+        statDeckFile(directoryItem.path(), stat);
+        auto it = stored.decks.find(deckName);
+        std::filesystem::file_time_type modified{std::filesystem::file_time_type::duration(stat.modified)};
+        bool settled = !error && modified + TIMESTAMP_RESOLUTION < manifestWritten;
+        if (it != stored.decks.end() && it->second.fileSize == stat.fileSize && it->second.modified == stat.modified && settled) {
+            current.decks[deckName] = it->second;
+            continue;
+        }
+
+        // The deck changed, or may have, since the manifest was written, so it is rehashed
+        std::shared_ptr<FlashCardDeck> deck = loadDeckFile(directoryItem.path().string());
+        if (!deck)
+            continue;
+        DeckDigest digest = digestDeck(deck);
+        digest.fileSize = stat.fileSize;
+        digest.modified = stat.modified;
+        current.decks[deckName] = digest;
+        changed = true;
+    }
+
+    if (changed || current.decks.size() != stored.decks.size()) {
+        updateLibraryDigest(current);
+        writeManifest(manifestPath.string(), current);
+    } else {
+        current.digest = stored.digest;
+    }
+    return current;
+}
+
+/**
+ * @brief Reads the hashes of the cards removed from a deck, which includes
+ * the old text of edited cards. A hash appears once for every copy of the
+ * card that was removed.
+ * @param directory the library directory
+ * @param deckName the deck
+ * @returns the hashes, sorted, empty if nothing was removed
+*/
+std::vector<uint64_t> readRemovedCards(const std::string& directory, const std::string& deckName)
+{
+    std::vector<uint64_t> hashes;
+    std::ifstream input(std::filesystem::path(directory) / REMOVED_DIRECTORY / deckName);
+    uint64_t hash;
+    while (input >> std::hex >> hash)
+        hashes.push_back(hash);
+    std::sort(hashes.begin(), hashes.end());
+    return hashes;
+}
+
+/**
+ * @brief Writes the hashes of the cards removed from a deck
+ * @param directory the library directory
+ * @param deckName the deck
+ * @param hashes the hashes, sorted
+ * @returns true if the file was written
+*/
+bool writeRemovedCards(const std::string& directory, const std::string& deckName, const std::vector<uint64_t>& hashes)
+{
+    std::filesystem::path path = std::filesystem::path(directory) / REMOVED_DIRECTORY / deckName;
+    std::error_code error;
+    if (hashes.empty()) {
+        std::filesystem::remove(path, error);
+        return true;
+    }
+
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::ofstream output(path);
+    for (uint64_t hash : hashes)
+        output << std::hex << hash << "\n";
+    return bool(output);
+}
+
+/**
+ * @brief Updates a deck's removed cards after it was saved. The hashes are
+ * counted, so removing one of two identical cards records one removal, and
+ * cards that came back, for example through undo, are forgotten again.
+ * @param directory the library directory
+ * @param deckName the deck
+ * @param before the version the deck file held
+ * @param after the version just written
+*/
+void recordRemovedCards(const std::string& directory, const std::string& deckName, const FlashCardDeck::Version& before, const FlashCardDeck::Version& after)
+{
+    std::vector<uint64_t> oldHashes = hashVersion(before);
+    std::vector<uint64_t> newHashes = hashVersion(after);
+    std::vector<uint64_t> removed;
+    std::vector<uint64_t> added;
+    std::set_difference(oldHashes.begin(), oldHashes.end(), newHashes.begin(), newHashes.end(), std::back_inserter(removed));
+    std::set_difference(newHashes.begin(), newHashes.end(), oldHashes.begin(), oldHashes.end(), std::back_inserter(added));
+    if (removed.empty() && added.empty())
+        return;
+
+    std::vector<uint64_t> known = readRemovedCards(directory, deckName);
+    std::vector<uint64_t> merged;
+    std::merge(known.begin(), known.end(), removed.begin(), removed.end(), std::back_inserter(merged));
+    std::vector<uint64_t> result;
+    std::set_difference(merged.begin(), merged.end(), added.begin(), added.end(), std::back_inserter(result));
+    if (result != known)
+        writeRemovedCards(directory, deckName, result);
+}
+
+/**
+ * @brief Merges one source deck into the target library. Cards the target
+ * already has, or has removed, are skipped. Cards the source has removed
+ * are removed from the target too, as many copies as the source removed
+ * but never fewer than the source still holds, and a card whose old text
+ * the source removed is replaced in place by the source's new text. When both sides
+ * changed a card with the same question, the card with the larger content
+ * hash wins, so syncing in both directions converges. Runs in time linear
+ * in the size of both copies of the deck.
+ * @param source the source deck
+ * @param sourceDigest the source deck's digest
+ * @param sourceRemoved hashes of the cards removed from the source deck, sorted
+ * @param targetDirectory the target library directory
+ * @param target the target manifest, updated in place
+ * @param report counters to update
+*/
+static void mergeDeck(const std::shared_ptr<FlashCardDeck> source, const DeckDigest& sourceDigest, const std::vector<uint64_t>& sourceRemoved,
+                      const std::string& targetDirectory, LibraryManifest& target, SyncReport& report)
+{
+    std::filesystem::path path = std::filesystem::path(targetDirectory) / sourceDigest.name;
+    auto existing = target.decks.find(sourceDigest.name);
+
+    // A deck the target lacks entirely is copied as is, along with its removals
+    if (existing == target.decks.end()) {
+        if (!writeDeckFile(source, path.string())) {
+            std::cerr << "Error creating deck file: " << path << std::endl;
+            return;
+        }
+        writeRemovedCards(targetDirectory, sourceDigest.name, sourceRemoved);
+        DeckDigest digest = sourceDigest;
+        statDeckFile(path, digest);
+        target.decks[digest.name] = digest;
+        report.decksChanged++;
+        report.cardsAdded += int(source->getCardCount());
+        report.bytesTransferred += digest.fileSize;
+        return;
+    }
+
+    // Only decks that differ get this far, both sides are read and hashed whole
+    std::shared_ptr<FlashCardDeck> deck = loadDeckFile(path.string());
+    if (!deck)
+        return;
+    std::vector<uint64_t> targetRemoved = readRemovedCards(targetDirectory, sourceDigest.name);
+    std::vector<uint64_t> newlyRemoved;
+
+    std::vector<uint64_t> have;
+    std::unordered_map<std::string, int> byQuestion;
+    int index = 0;
+    for (std::shared_ptr<FlashCard> card : deck->getCards()) {
+        have.push_back(hashCard(card->getQuestion(), card->getAnswer()));
+        byQuestion.emplace(card->getQuestion(), index++);
+    }
+    std::vector<uint64_t> haveSorted = have;
+    std::sort(haveSorted.begin(), haveSorted.end());
+
+    // Counts how many copies of each removed card the target should lose, so
+    // the target ends with as many copies as the source kept
+    std::vector<uint64_t> sourceHashes = hashCards(source);
+    std::unordered_map<uint64_t, size_t> toDrop;
+    for (auto it = sourceRemoved.begin(); it != sourceRemoved.end();) {
+        auto end = std::upper_bound(it, sourceRemoved.end(), *it);
+        auto held = std::equal_range(sourceHashes.begin(), sourceHashes.end(), *it);
+        auto kept = std::equal_range(haveSorted.begin(), haveSorted.end(), *it);
+        size_t sourceCount = held.second - held.first;
+        size_t targetCount = kept.second - kept.first;
+        if (targetCount > sourceCount)
+            toDrop[*it] = std::min(size_t(end - it), targetCount - sourceCount);
+        it = end;
+    }
+
+    // Marks the target's cards that the source has removed
+    std::vector<bool> dropped;
+    for (uint64_t hash : have) {
+        auto drop = toDrop.find(hash);
+        dropped.push_back(drop != toDrop.end() && drop->second > 0);
+        if (dropped.back())
+            drop->second--;
+    }
+
+    bool rewrite = false;
+    std::ostringstream appended;
+    for (std::shared_ptr<FlashCard> card : source->getCards()) {
+        uint64_t hash = hashCard(card->getQuestion(), card->getAnswer());
+        if (std::binary_search(haveSorted.begin(), haveSorted.end(), hash) || std::binary_search(targetRemoved.begin(), targetRemoved.end(), hash))
+            continue;
+
+        std::string line = card->getQuestion() + ":" + card->getAnswer() + "\n";
+        auto match = byQuestion.find(card->getQuestion());
+        if (match == byQuestion.end()) {
+            deck->addCard(std::make_shared<FlashCard>(card->getQuestion(), card->getAnswer()));
+            byQuestion.emplace(card->getQuestion(), int(deck->getCardCount()) - 1);
+            have.push_back(hash);
+            dropped.push_back(false);
+            appended << line;
+            report.cardsAdded++;
+        } else if (dropped[match->second] || hash > have[match->second]) {
+            // The source edited this card, or both sides did and the source's text wins
+            newlyRemoved.push_back(have[match->second]);
+            deck->editCard(match->second, card->getQuestion(), card->getAnswer());
+            have[match->second] = hash;
+            dropped[match->second] = false;
+            rewrite = true;
+            report.cardsReplaced++;
+        } else {
+            report.conflictsKept++;
+            continue;
+        }
+        report.bytesTransferred += line.size();
+    }
+
+    // Removes what the source removed and nothing replaced
+    std::vector<std::shared_ptr<FlashCard>> toRemove;
+    for (size_t i = 0; i < dropped.size(); i++) {
+        if (dropped[i]) {
+            toRemove.push_back(deck->getCard(int(i)));
+            newlyRemoved.push_back(have[i]);
+        }
+    }
+    if (!toRemove.empty()) {
+        deck->removeCards(toRemove);
+        rewrite = true;
+        report.cardsRemoved += int(toRemove.size());
+    }
+
+    // Keeps the source's removals as well, so they reach libraries synced from this one
+    std::sort(newlyRemoved.begin(), newlyRemoved.end());
+    std::vector<uint64_t> removed;
+    std::set_union(targetRemoved.begin(), targetRemoved.end(), sourceRemoved.begin(), sourceRemoved.end(), std::back_inserter(removed));
+    std::vector<uint64_t> allRemoved;
+    std::set_union(removed.begin(), removed.end(), newlyRemoved.begin(), newlyRemoved.end(), std::back_inserter(allRemoved));
+    if (allRemoved != targetRemoved)
+        writeRemovedCards(targetDirectory, sourceDigest.name, allRemoved);
+
+    // New cards are appended, only a replaced or removed card forces a rewrite,
+    // which also moves the media of a replaced card to its new text
+    if (rewrite) {
+        writeDeckFile(deck, path.string());
+        saveMediaRefs(deck, targetDirectory);
+    } else if (!appended.str().empty()) {
+        std::ofstream deckFile(path, std::ios::app);
+        deckFile << appended.str();
+    }
+
+    if (rewrite || !appended.str().empty()) {
+        DeckDigest digest = digestDeck(deck);
+        statDeckFile(path, digest);
+        target.decks[digest.name] = digest;
+        report.decksChanged++;
+    }
+}
+
+/**
+ * @brief Whether the target holds the same deck as the source
+ * @param target the target manifest
+ * @param sourceDigest digest of the source deck
+ * @returns true if nothing needs to be transferred
+*/
+static bool targetHasDeck(const LibraryManifest& target, const DeckDigest& sourceDigest)
+{
+    auto it = target.decks.find(sourceDigest.name);
+    return it != target.decks.end() && it->second.digest == sourceDigest.digest;
+}
+
+/**
+ * @brief Pulls everything the target library is missing from the source
+ * library, and removes what the source removed. Decks with matching
+ * digests are skipped without being read, so the cost follows the number
+ * of decks that changed. A changed deck is read and hashed in full on both
+ * sides, however few of its cards differ. Run in both directions for a
+ * two-way sync.
+ * @param sourceDirectory the library to copy from
+ * @param targetDirectory the library to copy into
+ * @returns what was changed in the target
+*/
+SyncReport syncLibraries(const std::string& sourceDirectory, const std::string& targetDirectory)
+{
+    SyncReport report;
+    LibraryManifest source = refreshManifest(sourceDirectory);
+    LibraryManifest target = refreshManifest(targetDirectory);
+    if (source.digest == target.digest)
+        return report;
+
+    for (const auto& entry : source.decks) {
+        report.decksCompared++;
+        if (targetHasDeck(target, entry.second))
+            continue;
+
+        std::shared_ptr<FlashCardDeck> deck = loadDeckFile((std::filesystem::path(sourceDirectory) / entry.first).string());
+        if (deck)
+            mergeDeck(deck, entry.second, readRemovedCards(sourceDirectory, entry.first), targetDirectory, target, report);
+    }
+
+    updateLibraryDigest(target);
+    writeManifest((std::filesystem::path(targetDirectory) / MANIFEST_FILE).string(), target);
+    return report;
+}
+
+/**
+ * @brief Writes a whole library into a single bundle file for transport.
+ * Each deck is followed by the hashes of its removed cards, so importing
+ * the bundle removes them elsewhere too.
+ * @param directory the library to export
+ * @param bundlePath the bundle file to create
+ * @returns true if the bundle was written
+*/
+bool exportBundle(const std::string& directory, const std::string& bundlePath)
+{
+    std::ofstream bundle(bundlePath);
+    if (!bundle)
+        return false;
+
+    bundle << "aroma-bundle 2\n";
+    for (std::shared_ptr<FlashCardDeck> deck : loadDecksFrom(directory)) {
+        std::vector<std::shared_ptr<FlashCard>> cards = deck->getCards();
+        bundle << std::dec << cards.size() << " " << deck->getName() << "\n";
+        for (std::shared_ptr<FlashCard> card : cards)
+            bundle << card->getQuestion() << ":" << card->getAnswer() << "\n";
+        for (uint64_t hash : readRemovedCards(directory, deck->getName()))
+            bundle << std::hex << hash << " ";
+        bundle << "\n";
+    }
+    return bool(bundle);
+}
+
+/**
+ * @brief Pulls everything the target library is missing from a bundle, and
+ * removes what the bundle's library removed
+ * @param bundlePath the bundle file to read
+ * @param targetDirectory the library to copy into
+ * @returns what was changed in the target
+*/
+SyncReport importBundle(const std::string& bundlePath, const std::string& targetDirectory)
+{
+    SyncReport report;
+    std::ifstream bundle(bundlePath);
+    std::string line;
+    if (!bundle || !std::getline(bundle, line) || (line != "aroma-bundle 1" && line != "aroma-bundle 2")) {
+        std::cerr << "Error opening bundle: " << bundlePath << std::endl;
+        return report;
+    }
+    bool hasRemovals = line == "aroma-bundle 2";
+
+    LibraryManifest target = refreshManifest(targetDirectory);
+    size_t count;
+    while (bundle >> std::dec >> count) {
+        std::string name;
+        bundle.get();
+        std::getline(bundle, name);
+        std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(name);
+        for (size_t i = 0; i < count && std::getline(bundle, line); i++) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos)
+                deck->addCard(std::make_shared<FlashCard>(line.substr(0, colon), line.substr(colon + 1)));
+        }
+        std::vector<uint64_t> removed;
+        if (hasRemovals && std::getline(bundle, line)) {
+            std::istringstream hashes(line);
+            uint64_t hash;
+            while (hashes >> std::hex >> hash)
+                removed.push_back(hash);
+            std::sort(removed.begin(), removed.end());
+        }
+
+        // Bundles come from other machines, so a name must not reach outside the library
+        if (!isValidDeckName(name)) {
+            std::cerr << "Skipping deck with invalid name in bundle: " << name << std::endl;
+            continue;
+        }
+
+        report.decksCompared++;
+        DeckDigest digest = digestDeck(deck);
+        if (!targetHasDeck(target, digest))
+            mergeDeck(deck, digest, removed, targetDirectory, target, report);
+    }
+
+    updateLibraryDigest(target);
+    writeManifest((std::filesystem::path(targetDirectory) / MANIFEST_FILE).string(), target);
+    return report;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file DuplicateFinder.cpp
+ * @brief Near-duplicate detection. Each card's normalised text is reduced to
+ * a MinHash signature, signatures are bucketed band by band (LSH) so only
+ * cards sharing a bucket are compared, and matching pairs are joined into
+ * clusters with a union-find.
+ * @author Ben Namo
+ */
+
+#include "../include/DuplicateFinder.h"
+#include "../include/Parallel.h"
+#include "../include/Hashing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+
+// Signature length, split into BANDS bands of ROWS values each. A pair of
+// cards becomes a candidate with probability 1 - (1 - s^ROWS)^BANDS, which
+// is steep around a similarity of 0.5
+static const int NUM_HASHES = 64;
+static const int BANDS = 16;
+static const int ROWS = NUM_HASHES / BANDS;
+static_assert(ROWS * 16 <= 64, "a band must fit in a 64 bit bucket key");
+
+// Length of the character shingles taken from each card
+static const size_t SHINGLE_SIZE = 3;
+
+/**
+ * @brief Scrambles the bits of a 32 bit value (murmur3 finalizer)
+ * @param x value to scramble
+ * @returns the scrambled value
+*/
+static inline uint32_t mix32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35U;
+    x ^= x >> 16;
+    return x;
+}
+
+/**
+ * @brief Lowercases text and collapses punctuation and whitespace, so that
+ * cosmetic differences do not hide a duplicate
+ * @param text the text to normalise
+ * @returns the normalised text, empty if it held only punctuation
+*/
+static std::string normalise(const std::string& text)
+{
+    std::string result;
+    result.reserve(text.size());
+    bool space = true;
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c >= 0x80) {
+            result.push_back(char(std::tolower(c)));
+            space = false;
+        } else if (!space) {
+            result.push_back(' ');
+            space = true;
+        }
+    }
+    if (!result.empty() && result.back() == ' ')
+        result.pop_back();
+    return result;
+}
+
+/**
+ * @brief Computes the MinHash signature of a card's text. Every shingle is
+ * hashed once, and the NUM_HASHES hash functions are seeded 32 bit mixes
+ * of that hash, which the compiler can vectorise. Only the low 16 bits
+ * of each minimum are kept, which halves the memory of a million card
+ * library at the cost of a 1 in 65536 chance of a false match per value.
+ * @param text normalised card text
+ * @param seeds one seed per hash function
+ * @param signature receives NUM_HASHES values
+*/
+static void minHash(const std::string& text, const uint32_t* seeds, uint16_t* signature)
+{
+    uint32_t minimums[NUM_HASHES];
+    std::fill(minimums, minimums + NUM_HASHES, UINT32_MAX);
+    size_t shingles = text.size() < SHINGLE_SIZE ? 1 : text.size() - SHINGLE_SIZE + 1;
+    for (size_t i = 0; i < shingles; i++) {
+        uint64_t shingle = 0;
+        for (size_t j = i; j < std::min(text.size(), i + SHINGLE_SIZE); j++)
+            shingle = (shingle << 8) | uint8_t(text[j]);
+        uint32_t hash = uint32_t(mix(shingle));
+        for (int h = 0; h < NUM_HASHES; h++)
+            minimums[h] = std::min(minimums[h], mix32(hash ^ seeds[h]));
+    }
+    for (int h = 0; h < NUM_HASHES; h++)
+        signature[h] = uint16_t(minimums[h]);
+}
+
+/**
+ * @brief Whether two cards' signatures agree in at least the given number
+ * of positions, giving up as soon as that can no longer happen
+ * @param a signature of the first card
+ * @param b signature of the second card
+ * @param required number of positions that must match
+ * @returns true if the cards are similar enough
+*/
+static bool similar(const uint16_t* a, const uint16_t* b, int required)
+{
+    int allowedMisses = NUM_HASHES - required;
+    for (int h = 0; h < NUM_HASHES; h++) {
+        if (a[h] != b[h] && --allowedMisses < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Estimates the Jaccard similarity of two cards from their signatures
+ * @param a signature of the first card
+ * @param b signature of the second card
+ * @returns the fraction of matching signature values
+*/
+static double similarity(const uint16_t* a, const uint16_t* b)
+{
+    int equal = 0;
+    for (int h = 0; h < NUM_HASHES; h++)
+        equal += a[h] == b[h];
+    return double(equal) / NUM_HASHES;
+}
+
+/**
+ * @brief Finds the root of an item in a union-find forest, halving paths
+ * @param parents the forest
+ * @param item the item to look up
+ * @returns the root of the item's set
+*/
+static uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t item)
+{
+    while (parents[item] != item) {
+        parents[item] = parents[parents[item]];
+        item = parents[item];
+    }
+    return item;
+}
+
+/**
+ * @brief Finds clusters of near-duplicate cards across all the given decks
+ * @param decks the decks to search
+ * @param threshold minimum estimated similarity for two cards to match
+ * @param threadCount number of threads to use, 0 for one per core
+ * @returns the clusters, largest first
+*/
+std::vector<DuplicateCluster> findDuplicates(const std::vector<std::shared_ptr<FlashCardDeck>>& decks, double threshold, unsigned threadCount)
+{
+    threadCount = threadCountFor(threadCount);
+
+    // Flattens the library into one list of cards
+    std::vector<CardRef> refs;
+    for (std::shared_ptr<FlashCardDeck> deck : decks) {
+        for (std::shared_ptr<FlashCard> card : deck->getCards())
+            refs.push_back({deck, card});
+    }
+    size_t count = refs.size();
+
+    uint32_t seeds[NUM_HASHES];
+    for (int h = 0; h < NUM_HASHES; h++)
+        seeds[h] = uint32_t(mix(uint64_t(h) + 1));
+
+    // Signatures live in one flat array, NUM_HASHES values per card. Cards
+    // only match when their answers agree, so the answers are hashed as well
+    std::vector<uint16_t> signatures(count * NUM_HASHES);
+    std::vector<uint64_t> answers(count);
+    std::vector<char> comparable(count);
+    auto signature = [&](size_t card) { return signatures.data() + card * NUM_HASHES; };
+    parallelFor(count, threadCount, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+            std::string question = normalise(refs[i].card->getQuestion());
+            std::string answer = normalise(refs[i].card->getAnswer());
+            comparable[i] = !question.empty() && !answer.empty();
+            answers[i] = std::hash<std::string>()(answer);
+            minHash(question + " " + answer, seeds, signature(i));
+        }
+    });
+    int required = int(threshold * NUM_HASHES + 0.999);
+    auto matches = [&](uint32_t a, uint32_t b) {
+        return answers[a] == answers[b] && similar(signature(a), signature(b), required);
+    };
+
+    // A side that is only punctuation normalises to nothing and would match every such card
+    std::vector<uint32_t> eligible;
+    for (uint32_t i = 0; i < count; i++) {
+        if (comparable[i])
+            eligible.push_back(i);
+    }
+
+    // Buckets every band separately, cards with an equal band key are candidates.
+    // Within a bucket the cards are grouped by answer, since only those can match
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> threadPairs(threadCount);
+    parallelFor(BANDS, threadCount, [&](size_t begin, size_t end, unsigned t) {
+        std::vector<std::tuple<uint64_t, uint64_t, uint32_t>> keys(eligible.size());
+        for (size_t band = begin; band < end; band++) {
+            for (size_t i = 0; i < eligible.size(); i++) {
+                // The band's four 16 bit values fill the key exactly
+                uint64_t key = 0;
+                for (int r = 0; r < ROWS; r++)
+                    key = (key << 16) | signature(eligible[i])[band * ROWS + r];
+                keys[i] = {key, answers[eligible[i]], eligible[i]};
+            }
+            std::sort(keys.begin(), keys.end());
+
+            // Compares each member of a run of equal keys and answers with the
+            // run's first card and its neighbour, which keeps large runs of exact
+            // copies linear
+            size_t start = 0;
+            for (size_t i = 1; i <= keys.size(); i++) {
+                if (i < keys.size() && std::get<0>(keys[i]) == std::get<0>(keys[start]) && std::get<1>(keys[i]) == std::get<1>(keys[start]))
+                    continue;
+                uint32_t first = std::get<2>(keys[start]);
+                for (size_t j = start + 1; j < i; j++) {
+                    uint32_t card = std::get<2>(keys[j]);
+                    uint32_t previous = std::get<2>(keys[j - 1]);
+                    if (matches(first, card))
+                        threadPairs[t].push_back({first, card});
+                    else if (j > start + 1 && matches(previous, card))
+                        threadPairs[t].push_back({previous, card});
+                }
+                start = i;
+            }
+        }
+    });
+
+    std::vector<uint32_t> parents(count);
+    std::iota(parents.begin(), parents.end(), 0);
+    for (const auto& pairs : threadPairs) {
+        for (const auto& pair : pairs) {
+            uint32_t a = findRoot(parents, pair.first);
+            uint32_t b = findRoot(parents, pair.second);
+            if (a != b)
+                parents[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    // Groups cards by root, in library order so the earliest card is kept
+    std::map<uint32_t, std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t root = findRoot(parents, i);
+        if (root != i)
+            groups[root].push_back(i);
+    }
+
+    std::vector<DuplicateCluster> clusters;
+    for (auto& group : groups) {
+        std::vector<uint32_t>& members = group.second;
+        members.insert(members.begin(), group.first);
+
+        DuplicateCluster cluster;
+        cluster.similarity = 1;
+        for (uint32_t member : members) {
+            cluster.cards.push_back(refs[member]);
+            cluster.similarity = std::min(cluster.similarity, similarity(signature(members[0]), signature(member)));
+        }
+        clusters.push_back(cluster);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const DuplicateCluster& a, const DuplicateCluster& b) {
+        return a.cards.size() > b.cards.size();
+    });
+    return clusters;
+}
+
+/**
+ * @brief Merges each cluster into its first card by removing the others
+ * from their decks. The kept card takes over the media of the removed
+ * cards, after its own.
+ * @param clusters the clusters to merge
+ * @returns the number of cards removed
+*/
+int mergeClusters(const std::vector<DuplicateCluster>& clusters)
+{
+    // Collects removals per deck so each deck is compacted once
+    std::map<std::shared_ptr<FlashCardDeck>, std::vector<std::shared_ptr<FlashCard>>> removals;
+    std::map<std::shared_ptr<FlashCardDeck>, std::map<std::shared_ptr<FlashCard>, std::vector<std::string>>> mediaChanges;
+    int removed = 0;
+    for (const DuplicateCluster& cluster : clusters) {
+        std::vector<std::string> media = cluster.cards[0].card->getMedia();
+        bool gained = false;
+        for (size_t i = 1; i < cluster.cards.size(); i++) {
+            removals[cluster.cards[i].deck].push_back(cluster.cards[i].card);
+            removed++;
+            for (const std::string& hash : cluster.cards[i].card->getMedia()) {
+                if (std::find(media.begin(), media.end(), hash) == media.end()) {
+                    media.push_back(hash);
+                    gained = true;
+                }
+            }
+        }
+        if (gained)
+            mediaChanges[cluster.cards[0].deck][cluster.cards[0].card] = media;
+    }
+
+    // Replaces each kept card that gained media, since older deck versions still share the old card
+    for (auto& entry : mediaChanges) {
+        std::vector<std::shared_ptr<FlashCard>> cards = entry.first->getCards();
+        for (size_t i = 0; i < cards.size(); i++) {
+            auto media = entry.second.find(cards[i]);
+            if (media == entry.second.end())
+                continue;
+            std::shared_ptr<FlashCard> card = std::make_shared<FlashCard>(cards[i]->getQuestion(), cards[i]->getAnswer());
+            card->setMedia(media->second);
+            entry.first->setCard(int(i), card);
+        }
+    }
+
+    for (auto& entry : removals)
+        entry.first->removeCards(entry.second);
+    return removed;
+}
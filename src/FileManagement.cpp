@@ -5,38 +5,142 @@
  */
 
 #include "../include/FileManagement.h"
+#include "../include/DeckSync.h"
+#include "../include/MediaStore.h"
+
+#include <future>
+#include <map>
+#include <mutex>
+
+// The version of each deck last written to or read from its file, keyed by path
+static std::map<std::string, FlashCardDeck::Version> savedVersions;
+static std::mutex savedVersionsMutex;
+
+/**
+ * @brief Gets the key a deck file is tracked under in savedVersions
+ * @param path the deck file
+ * @returns the normalised path
+*/
+static std::string savedVersionKey(const std::string& path)
+{
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+/**
+ * @brief Gets the version a deck file is known to hold
+ * @param path the deck file
+ * @param version receives the version
+ * @returns false if the file's content is not known
+*/
+static bool findSavedVersion(const std::string& path, FlashCardDeck::Version& version)
+{
+    std::lock_guard<std::mutex> lock(savedVersionsMutex);
+    auto it = savedVersions.find(savedVersionKey(path));
+    if (it == savedVersions.end())
+        return false;
+    version = it->second;
+    return true;
+}
+
+/**
+ * @brief Records that a deck file holds the given version
+ * @param path the deck file
+ * @param version the version written or read
+*/
+static void markSavedVersion(const std::string& path, const FlashCardDeck::Version& version)
+{
+    std::lock_guard<std::mutex> lock(savedVersionsMutex);
+    savedVersions[savedVersionKey(path)] = version;
+}
 
 /**
  * @brief takes in a vector of decks, and saves them into the file system
  * @param decks list of decks to save
 */
 void saveDecks(const std::vector<std::shared_ptr<FlashCardDeck>> decks)
+{
+    saveDecksTo(decks, "decks");
+}
+
+/**
+ * @brief saves a vector of decks into the given library directory, and
+ * refreshes the library's sync manifest. Decks still at the version last
+ * written or read are skipped, so their files keep their modification
+ * times and the manifest only rehashes what changed.
+ * @param decks list of decks to save
+ * @param directory the library directory to write into
+*/
+void saveDecksTo(const std::vector<std::shared_ptr<FlashCardDeck>> decks, const std::string& directory)
 {
 
     // Loops over each deck in the given vector
     for (std::shared_ptr<FlashCardDeck> deck : decks) {
 
-        // Creates a new file with the name of the current deck
-        std::string name = deck->getName();
+        // Creates a new file with the name of the current deck, unless it is unchanged
         std::ostringstream deckFileName;
-        deckFileName << "decks" << "/" << name;
-        std::ofstream deckFile(deckFileName.str());
-
-        // Catches errors
-        if (!deckFile) {
+        deckFileName << directory << "/" << deck->getName();
+        FlashCardDeck::Version version = deck->snapshot();
+        FlashCardDeck::Version saved;
+        bool known = findSavedVersion(deckFileName.str(), saved);
+        if (known && saved.sameVersion(version))
+            continue;
+
+        // Reports errors, and carries on so one bad file does not cost the other decks
+        if (!writeDeckFile(deck, deckFileName.str())) {
             std::cerr << "Error creating deck file: " << deckFileName.str() << std::endl;
-            return;
+            continue;
         }
+        saveMediaRefs(deck, directory);
+        markSavedVersion(deckFileName.str(), version);
 
-        // Loops over each question and answer, and writes it to the file
-        for (std::shared_ptr<FlashCard> card : deck->getCards())
-        {
-            deckFile << card->getQuestion() << ":" << card->getAnswer() << std::endl;
-        }
+        // Remembers removed and edited cards, so a sync removes them elsewhere instead of bringing them back
+        if (known)
+            recordRemovedCards(directory, deck->getName(), saved, version);
+    }
 
-        // Closes the file
-        deckFile.close();
+    // Records the content hashes of what was just written, for later syncs
+    refreshManifest(directory);
+}
+
+/**
+ * @brief saves the decks into the file system on a worker thread. Each deck
+ * is snapshotted first, which is O(1), so the decks can keep being edited
+ * while the worker writes the versions that were current at the call.
+ * @param decks list of decks to save
+ * @returns a future that is ready once the decks are written
+*/
+std::future<void> saveDecksInBackground(const std::vector<std::shared_ptr<FlashCardDeck>> decks)
+{
+    std::vector<std::shared_ptr<FlashCardDeck>> snapshots;
+    for (std::shared_ptr<FlashCardDeck> deck : decks) {
+        std::shared_ptr<FlashCardDeck> snapshot = std::make_shared<FlashCardDeck>(deck->getName());
+        snapshot->restore(deck->snapshot());
+        snapshots.push_back(snapshot);
     }
+    return std::async(std::launch::async, [snapshots]() { saveDecks(snapshots); });
+}
+
+/**
+ * @brief writes a single deck to the given file, one card per line
+ * @param deck the deck to write
+ * @param path the file to write to
+ * @returns true if the file was written
+*/
+bool writeDeckFile(const std::shared_ptr<FlashCardDeck> deck, const std::string& path)
+{
+    std::ofstream deckFile(path);
+    if (!deckFile)
+        return false;
+
+    // Loops over each question and answer, and writes it to the file
+    for (std::shared_ptr<FlashCard> card : deck->getCards())
+    {
+        deckFile << card->getQuestion() << ":" << card->getAnswer() << std::endl;
+    }
+
+    // Closes the file
+    deckFile.close();
+    return bool(deckFile);
 }
 
 /**
@@ -44,58 +148,88 @@ void saveDecks(const std::vector<std::shared_ptr<FlashCardDeck>> decks)
  * @returns A vector of all card decks found
 */
 std::vector<std::shared_ptr<FlashCardDeck>> loadDecks()
+{
+    std::vector<std::shared_ptr<FlashCardDeck>> decks = loadDecksFrom("decks");
+
+    // The files hold exactly these versions, so saving them again can be skipped
+    for (std::shared_ptr<FlashCardDeck> deck : decks)
+        markSavedVersion("decks/" + deck->getName(), deck->snapshot());
+    return decks;
+}
+
+/**
+ * @brief Loads all the decks in the given library directory into a vector.
+ * Hidden files such as the sync manifest are skipped.
+ * @param directory the library directory to read
+ * @returns A vector of all card decks found
+*/
+std::vector<std::shared_ptr<FlashCardDeck>> loadDecksFrom(const std::string& directory)
 {
 
     // Creates vector to return
     std::vector<std::shared_ptr<FlashCardDeck>> decks;
 
-    // Loops over every file in the directory called decks
-    for (const auto& directoryItem : std::__fs::filesystem::directory_iterator("decks")) 
+    // Loops over every file in the library directory
+    for (const auto& directoryItem : std::filesystem::directory_iterator(directory)) 
     {
 
-        // Ensures that this is a file
-        if (directoryItem.is_regular_file()) 
+        // Ensures that this is a deck file
+        std::string deckName = directoryItem.path().filename().string();
+        if (directoryItem.is_regular_file() && deckName[0] != '.') 
         {
-
-            // Opens a fileStream to read
-            std::ifstream inputFile(directoryItem.path());
-            if (inputFile.is_open()) 
-            {
-
-                // Creates a deck object to edit from file
-                std::string deckName = directoryItem.path().filename().string();
-                std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(deckName);
-
-                // Loops until no more lines are available
-                std::string line;
-                while (std::getline(inputFile, line)) 
-                {
-                    std::istringstream iss(line);
-                    std::string question;
-                    std::string answer;
-
-                    // Splits line into question and answer
-                    if (std::getline(iss, question, ':') && std::getline(iss, answer)) 
-                    {
-
-                        // Creates a FlashCard with question and answer, adds it to the deck
-                        std::shared_ptr<FlashCard> card = std::make_shared<FlashCard>(question, answer);
-                        deck->addCard(card);
-                    }
-                }
-
-                // Closes current file, and adds deck to the vector
-                inputFile.close();
+            std::shared_ptr<FlashCardDeck> deck = loadDeckFile(directoryItem.path().string());
+            if (deck)
                 decks.push_back(deck);
-            } 
-            else 
-            {
-
-                // Prints error if files cannot be opened
-                std::cerr << "Error opening file: " << directoryItem.path() << std::endl;
-            }
         }
     }
 
     return decks;
 }
+
+/**
+ * @brief Loads a single deck file, the deck is named after the file
+ * @param path the deck file to read
+ * @returns the deck, or a null pointer if the file cannot be opened
+*/
+std::shared_ptr<FlashCardDeck> loadDeckFile(const std::string& path)
+{
+
+    // Opens a fileStream to read
+    std::ifstream inputFile(path);
+    if (!inputFile.is_open()) 
+    {
+
+        // Prints error if files cannot be opened
+        std::cerr << "Error opening file: " << path << std::endl;
+        return nullptr;
+    }
+
+    // Creates a deck object to edit from file
+    std::string deckName = std::filesystem::path(path).filename().string();
+    std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(deckName);
+    std::vector<std::shared_ptr<FlashCard>> cards;
+
+    // Loops until no more lines are available
+    std::string line;
+    while (std::getline(inputFile, line)) 
+    {
+        std::istringstream iss(line);
+        std::string question;
+        std::string answer;
+
+        // Splits line into question and answer
+        if (std::getline(iss, question, ':') && std::getline(iss, answer)) 
+        {
+
+            // Creates a FlashCard with question and answer, adds it to the list
+            std::shared_ptr<FlashCard> card = std::make_shared<FlashCard>(question, answer);
+            cards.push_back(card);
+        }
+    }
+
+    // Closes current file, and builds the deck's contents in one step
+    inputFile.close();
+    deck->restore(FlashCardDeck::Version(cards));
+    loadMediaRefs(deck, std::filesystem::path(path).parent_path().string());
+    return deck;
+}
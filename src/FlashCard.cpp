@@ -54,6 +54,24 @@ std::string FlashCard::getAnswer()
     return answer;
 }
 
+/**
+ * @brief Setter for the media attached to the card
+ * @param m content hashes of the media, in display order
+*/
+void FlashCard::setMedia(const std::vector<std::string>& m)
+{
+    media = m;
+}
+
+/**
+ * @brief Getter for the media attached to the card
+ * @returns content hashes of the media, empty for a text-only card
+*/
+std::vector<std::string> FlashCard::getMedia()
+{
+    return media;
+}
+
 /**
  * @brief toString method for flash card
  * @returns the string representation of the card
@@ -19,6 +19,7 @@ wxIMPLEMENT_APP(FlashCardApp);
  * @return True if initialization is successful, false otherwise.
  */
 bool FlashCardApp::OnInit() {
+    wxInitAllImageHandlers();
     FlashCardFrame* frame = new FlashCardFrame("Aroma Cards", wxDefaultPosition, wxSize(800, 600));
     frame->Show(true);
     return true;
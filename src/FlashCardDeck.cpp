@@ -6,6 +6,7 @@
 
 #include "../include/FlashCardDeck.h"
 #include <iostream>
+#include <unordered_set>
 
 /**
  * @brief Constructor for the Flash Card Deck, simply sets the deck name
@@ -22,7 +23,16 @@ FlashCardDeck::FlashCardDeck(const std::string& name)
 */
 std::vector<std::shared_ptr<FlashCard>> FlashCardDeck::getCards() 
 {
-    return cards;
+    return cards.toVector();
+}
+
+/**
+ * @brief Gets the number of cards in the deck
+ * @returns the number of cards
+*/
+size_t FlashCardDeck::getCardCount()
+{
+    return cards.size();
 }
 
 /**
@@ -41,15 +51,9 @@ std::string FlashCardDeck::getName()
 */
 std::shared_ptr<FlashCard> FlashCardDeck::getCard(int index)
 {
-    int i = 0;
-    // Loops through all cards incrementing the index, if index matches, return card
-    for (auto card : cards)
-    {
-        if (i == index)
-            return card;
-        i++;
-    }
-    return nullptr;
+    if (index < 0 || size_t(index) >= cards.size())
+        return nullptr;
+    return cards.at(index);
 }
 
 /**
@@ -58,7 +62,36 @@ std::shared_ptr<FlashCard> FlashCardDeck::getCard(int index)
 */
 void FlashCardDeck::addCard(const std::shared_ptr<FlashCard> card) 
 {
-    cards.push_back(std::move(card));
+    cards = cards.pushBack(card);
+}
+
+/**
+ * @brief Replaces the card at the given index with a new card, leaving the
+ * old card untouched so that earlier versions of the deck keep their text
+ * @param index index of the card to replace
+ * @param question question for the new card
+ * @param answer answer for the new card
+*/
+void FlashCardDeck::editCard(int index, const std::string& question, const std::string& answer)
+{
+    if (index < 0 || size_t(index) >= cards.size())
+        return;
+
+    // Keeps the media of the card being replaced
+    std::shared_ptr<FlashCard> card = std::make_shared<FlashCard>(question, answer);
+    card->setMedia(cards.at(index)->getMedia());
+    cards = cards.set(index, card);
+}
+
+/**
+ * @brief Puts the given card at the given index in place of the old one
+ * @param index index of the card to replace
+ * @param card the new card
+*/
+void FlashCardDeck::setCard(int index, const std::shared_ptr<FlashCard> card)
+{
+    if (index >= 0 && size_t(index) < cards.size())
+        cards = cards.set(index, card);
 }
 
 /**
@@ -68,15 +101,83 @@ void FlashCardDeck::addCard(const std::shared_ptr<FlashCard> card)
 void FlashCardDeck::removeCard(const std::shared_ptr<FlashCard> card) 
 {
 
-    // Iterates over all cards, if currect card == given card, remove it
-    for (auto it = cards.begin(); it != cards.end(); ++it) {
-        auto value = *it;
-        if (card == value) 
-        {
-            cards.erase(it);
-            return;
-        }
+    // Finds the index of the given card, then removes the card at that index
+    int index = 0;
+    int found = -1;
+    cards.forEach([&](const std::shared_ptr<FlashCard>& value) {
+        if (found == -1 && card == value)
+            found = index;
+        index++;
+    });
+    if (found != -1)
+        removeCardAt(found);
+}
+
+/**
+ * @brief Removes the card at the given index
+ * @param index index of the card to remove
+*/
+void FlashCardDeck::removeCardAt(int index)
+{
+    if (index >= 0 && size_t(index) < cards.size())
+        cards = cards.erase(index);
+}
+
+/**
+ * @brief Removes all of the given cards from the deck in a single pass.
+ * A few cards are erased one by one, so the new version shares all but
+ * their paths with the old one and an undo entry stays small. Only when
+ * that would copy more nodes than the deck holds is the deck rebuilt.
+ * @param toRemove the cards to remove
+*/
+void FlashCardDeck::removeCards(const std::vector<std::shared_ptr<FlashCard>>& toRemove)
+{
+    std::unordered_set<std::shared_ptr<FlashCard>> removeSet(toRemove.begin(), toRemove.end());
+
+    std::vector<size_t> removed;
+    size_t index = 0;
+    cards.forEach([&](const std::shared_ptr<FlashCard>& card) {
+        if (removeSet.count(card) != 0)
+            removed.push_back(index);
+        index++;
+    });
+
+    size_t depth = 1;
+    while ((size_t(1) << depth) < cards.size())
+        depth++;
+    if (removed.size() * depth < cards.size()) {
+        for (auto it = removed.rbegin(); it != removed.rend(); ++it)
+            cards = cards.erase(*it);
+        return;
     }
+
+    // Keeps every other card, then rebuilds the deck from them
+    std::vector<std::shared_ptr<FlashCard>> kept;
+    cards.forEach([&](const std::shared_ptr<FlashCard>& card) {
+        if (removeSet.count(card) == 0)
+            kept.push_back(card);
+    });
+    cards = Version(kept);
+}
+
+/**
+ * @brief Gets the current version of the deck's contents. Taking a
+ * snapshot is O(1), and the snapshot is unaffected by later edits, so it can
+ * be saved or indexed on another thread.
+ * @returns the current version
+*/
+FlashCardDeck::Version FlashCardDeck::snapshot()
+{
+    return cards;
+}
+
+/**
+ * @brief Replaces the deck's contents with an earlier or later version
+ * @param version the version to restore
+*/
+void FlashCardDeck::restore(const Version& version)
+{
+    cards = version;
 }
 
 /**
@@ -88,8 +189,8 @@ std::string FlashCardDeck::toString()
     std::string result = name + "\n";
 
     // Loops over each card, appending the result of it's toString to the resultant string
-    for (std::shared_ptr<FlashCard>& card : cards) {
+    cards.forEach([&](const std::shared_ptr<FlashCard>& card) {
         result += card->toString() + "\n\n";
-    }
+    });
     return result;
 }
@@ -5,36 +5,74 @@
  */
 
 #include "../include/FlashCardDialog.h"
+#include "../include/MediaStore.h"
+
+// Size card images are scaled to fit, decoded images are cached at this size
+static const wxSize MEDIA_SIZE(480, 360);
+
+/**
+ * @brief Converts pixels decoded off the UI thread into a bitmap.
+ * The pixels are already scaled, so this stays well under a frame.
+ * @param image The decoded image.
+ * @return The bitmap to display.
+ */
+static wxBitmap ToBitmap(const DecodedImage& image) {
+    // Wraps the cached buffers without copying, wxBitmap takes its own copy
+    unsigned char* rgb = const_cast<unsigned char*>(image.rgb.data());
+    wxImage wrapped(image.width, image.height, rgb, true);
+    if (!image.alpha.empty())
+        wrapped.SetAlpha(const_cast<unsigned char*>(image.alpha.data()), true);
+    return wxBitmap(wrapped);
+}
 
 /**
  * @brief Constructor for the FlashCardDialog class.
  * @param parent The parent window.
  * @param title The title of the dialog.
- * @param flashcards The vector of flashcards to display.
+ * @param deck The deck whose flashcards to display.
+ * @param mediaCache The cache that decodes and holds card images.
+ * @param allowAttach Whether images may be attached to the deck's cards.
  */
-FlashCardDialog::FlashCardDialog(wxWindow* parent, const wxString& title, const std::vector<std::shared_ptr<FlashCard>>& flashcards)
-    : wxDialog(parent, wxID_ANY, title, wxDefaultPosition, wxSize(400, 300)), flashcards(flashcards), currentCardIndex(0), flipped(false) {
+FlashCardDialog::FlashCardDialog(wxWindow* parent, const wxString& title, std::shared_ptr<FlashCardDeck> deck, std::shared_ptr<MediaCache> mediaCache, bool allowAttach)
+    : wxDialog(parent, wxID_ANY, title, wxDefaultPosition, wxSize(400, 300)), deck(deck), flashcards(deck->getCards()), mediaCache(mediaCache),
+      alive(std::make_shared<bool>(true)), currentCardIndex(0), flipped(false) {
 
     // Create UI elements
     flashcardText = new wxStaticText(this, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxALIGN_CENTRE);
+    mediaBitmap = new wxStaticBitmap(this, wxID_ANY, wxNullBitmap, wxDefaultPosition, MEDIA_SIZE);
+
+    // Only reserves room for images when the deck has any
+    bool hasMedia = false;
+    for (std::shared_ptr<FlashCard> card : flashcards) {
+        if (!card->getMedia().empty()) {
+            hasMedia = true;
+            break;
+        }
+    }
+    mediaBitmap->Show(hasMedia);
 
     // Set up sizers for layout
     wxBoxSizer* vBox = new wxBoxSizer(wxVERTICAL);
+    vBox->Add(mediaBitmap, 0, wxALIGN_CENTER | wxALL, 10);
     vBox->Add(flashcardText, 1, wxEXPAND | wxALL, 10);
 
     wxBoxSizer* hBox = new wxBoxSizer(wxHORIZONTAL);
     wxButton* prevButton = new wxButton(this, wxID_ANY, "Previous");
     wxButton* flipButton = new wxButton(this, wxID_ANY, "Flip");
     wxButton* nextButton = new wxButton(this, wxID_ANY, "Next");
+    wxButton* attachButton = new wxButton(this, wxID_ANY, "Attach Image");
+    attachButton->Enable(allowAttach);
 
     // Bind events to event handlers
     prevButton->Bind(wxEVT_BUTTON, &FlashCardDialog::OnPrevious, this);
     flipButton->Bind(wxEVT_BUTTON, &FlashCardDialog::OnFlip, this);
     nextButton->Bind(wxEVT_BUTTON, &FlashCardDialog::OnNext, this);
+    attachButton->Bind(wxEVT_BUTTON, &FlashCardDialog::OnAttachImage, this);
 
     hBox->Add(prevButton, 0, wxALL, 10);
     hBox->Add(flipButton, 0, wxALL, 10);
     hBox->Add(nextButton, 0, wxALL, 10);
+    hBox->Add(attachButton, 0, wxALL, 10);
 
     vBox->Add(hBox, 0, wxEXPAND);
     SetSizerAndFit(vBox);
@@ -83,11 +121,79 @@ void FlashCardDialog::OnFlip(wxCommandEvent& event) {
     }
 }
 
+/**
+ * @brief Event handler for attaching an image to the current flashcard.
+ * Copies the chosen file into the library's media store and replaces the
+ * card with one that shows it in place of any image it had.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardDialog::OnAttachImage(wxCommandEvent& event) {
+    wxFileDialog fileDialog(this, "Choose an image", "", "", "Images (*.png;*.jpg;*.jpeg;*.bmp;*.gif)|*.png;*.jpg;*.jpeg;*.bmp;*.gif", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (fileDialog.ShowModal() != wxID_OK)
+        return;
+
+    std::string hash = importMedia("decks", fileDialog.GetPath().utf8_string());
+    if (hash.empty()) {
+        wxMessageBox("Could not store the image.", "Error", wxOK | wxICON_ERROR, this);
+        return;
+    }
+
+    std::shared_ptr<FlashCard> current = flashcards[currentCardIndex];
+    std::shared_ptr<FlashCard> card = std::make_shared<FlashCard>(current->getQuestion(), current->getAnswer());
+    card->setMedia({ hash });
+    deck->setCard(int(currentCardIndex), card);
+    flashcards[currentCardIndex] = card;
+
+    if (!mediaBitmap->IsShown()) {
+        mediaBitmap->Show();
+        Fit();
+    }
+    ShowMedia();
+}
+
+/**
+ * @brief Displays the image of the current flashcard if it is cached, and
+ * otherwise asks for it to be decoded in the background. Also prefetches
+ * the images of the neighbouring cards.
+ */
+void FlashCardDialog::ShowMedia() {
+    if (!mediaBitmap->IsShown())
+        return;
+
+    std::vector<std::string> media = flashcards[currentCardIndex]->getMedia();
+    if (media.empty()) {
+        mediaBitmap->SetBitmap(wxNullBitmap);
+    } else {
+        std::string path = mediaPath("decks", media[0]);
+        std::shared_ptr<const DecodedImage> image = mediaCache->get(path, MEDIA_SIZE);
+        if (image) {
+            mediaBitmap->SetBitmap(ToBitmap(*image));
+        } else {
+            // Shows nothing until the image is decoded, unless the user has moved on by then
+            mediaBitmap->SetBitmap(wxNullBitmap);
+            std::weak_ptr<bool> token = alive;
+            size_t index = currentCardIndex;
+            mediaCache->request(path, MEDIA_SIZE, [this, token, index]() {
+                if (token.lock() && currentCardIndex == index)
+                    ShowMedia();
+            });
+        }
+    }
+
+    for (size_t neighbour : { currentCardIndex + 1, currentCardIndex - 1 }) {
+        if (neighbour < flashcards.size()) {
+            for (const std::string& hash : flashcards[neighbour]->getMedia())
+                mediaCache->prefetch(mediaPath("decks", hash), MEDIA_SIZE);
+        }
+    }
+}
+
 /**
  * @brief Displays the question of the current flashcard.
  */
 void FlashCardDialog::ShowQuestion() {
     flashcardText->SetLabel(wxString::Format("Question: %s", flashcards[currentCardIndex]->getQuestion()));
+    ShowMedia();
 }
 
 /**
@@ -7,6 +7,34 @@
 #include "../include/FlashCardFrame.h"
 #include "../include/FileManagement.h"
 #include "../include/AromaControl.h"
+#include "../include/DeckClient.h"
+#include "../include/DeckFormat.h"
+#include "../include/DeckSync.h"
+#include "../include/DuplicateFinder.h"
+#include "../include/BatchEditDialog.h"
+
+// How often the deck server is polled for change notifications, in milliseconds
+static const int SERVER_POLL_INTERVAL = 250;
+
+// How often edited decks are saved in the background, in milliseconds
+static const int AUTOSAVE_INTERVAL = 30000;
+
+// Memory kept for decoded card images, in bytes
+static const size_t MEDIA_CACHE_BYTES = 64 * 1024 * 1024;
+
+/**
+ * @brief Maps an aroma from the library to the pin of its diffuser
+ * @param aroma the aroma's number in the library, 1 to 3
+ * @returns the pin, or -1 if there is no such aroma
+ */
+static int aromaPin(int aroma) {
+    switch (aroma) {
+    case 1: return PIN_ONE;
+    case 2: return PIN_TWO;
+    case 3: return PIN_THREE;
+    default: return -1;
+    }
+}
 
 /**
  * @brief Constructor for the FlashCardFrame class.
@@ -26,6 +54,11 @@ FlashCardFrame::FlashCardFrame(const wxString& title, const wxPoint& pos, const
     createButton = new wxButton(panel, wxID_ANY, "Create Deck");
     addCardButton = new wxButton(panel, wxID_ANY, "Add Card");
     aromaLibraryButton = new wxButton(panel, wxID_ANY, "Aroma Library"); 
+    syncButton = new wxButton(panel, wxID_ANY, "Sync Library");
+    duplicatesButton = new wxButton(panel, wxID_ANY, "Find Duplicates");
+    batchEditButton = new wxButton(panel, wxID_ANY, "Batch Edit");
+    undoButton = new wxButton(panel, wxID_ANY, "Undo");
+    redoButton = new wxButton(panel, wxID_ANY, "Redo");
     aromaToggle= new wxCheckBox(panel, wxID_ANY, "Toggle Aroma", wxDefaultPosition, wxDefaultSize, 0, wxDefaultValidator);
     
     // Create sizers for layout
@@ -38,6 +71,11 @@ FlashCardFrame::FlashCardFrame(const wxString& title, const wxPoint& pos, const
     hBox->Add(selectButton, 0, wxALIGN_CENTER | wxALL, 10);
     hBox->Add(createButton, 0, wxALIGN_CENTER | wxALL, 10);
     hBox->Add(addCardButton, 0, wxALIGN_CENTER | wxALL, 10); 
+    hBox->Add(syncButton, 0, wxALIGN_CENTER | wxALL, 10);
+    hBox->Add(duplicatesButton, 0, wxALIGN_CENTER | wxALL, 10);
+    hBox->Add(batchEditButton, 0, wxALIGN_CENTER | wxALL, 10);
+    hBox->Add(undoButton, 0, wxALIGN_CENTER | wxALL, 10);
+    hBox->Add(redoButton, 0, wxALIGN_CENTER | wxALL, 10);
     vBox->Add(deckListBox, 1, wxEXPAND | wxALL, 10);
     vBox->Add(hBox, 0, wxALIGN_CENTER | wxALL, 10);
     
@@ -52,22 +90,43 @@ FlashCardFrame::FlashCardFrame(const wxString& title, const wxPoint& pos, const
     selectButton->Bind(wxEVT_BUTTON, &FlashCardFrame::OnShowFlashcard, this);
     createButton->Bind(wxEVT_BUTTON, &FlashCardFrame::createDeck, this);
     addCardButton->Bind(wxEVT_BUTTON, &FlashCardFrame::addCard, this); 
+    syncButton->Bind(wxEVT_BUTTON, &FlashCardFrame::syncLibrary, this);
+    duplicatesButton->Bind(wxEVT_BUTTON, &FlashCardFrame::findDuplicateCards, this);
+    batchEditButton->Bind(wxEVT_BUTTON, &FlashCardFrame::batchEdit, this);
+    undoButton->Bind(wxEVT_BUTTON, &FlashCardFrame::undo, this);
+    redoButton->Bind(wxEVT_BUTTON, &FlashCardFrame::redo, this);
+    UpdateHistoryButtons();
     aromaLibraryButton->Bind(wxEVT_BUTTON, &FlashCardFrame::toggleAromaLibrary, this); 
     aromaToggle->Bind(wxEVT_CHECKBOX, &FlashCardFrame::toggleAromaSync, this);
     Connect(wxEVT_CLOSE_WINDOW, wxCloseEventHandler(FlashCardFrame::OnClose));
 
-    // Load existing decks
-    decks = loadDecks();
+    mediaCache = std::make_shared<MediaCache>(MEDIA_CACHE_BYTES);
+
+    // Uses the shared deck server when one is running, otherwise owns the files and pins directly
+    deckClient = std::make_unique<DeckClient>();
+    if (deckClient->connectTo() && deckClient->subscribe()) {
+        decks = deckClient->loadDecks();
+        serverPollTimer.SetOwner(this);
+        Bind(wxEVT_TIMER, &FlashCardFrame::OnServerPoll, this, serverPollTimer.GetId());
+        serverPollTimer.Start(SERVER_POLL_INTERVAL);
+    } else {
+        deckClient.reset();
+        decks = loadDecks();
+        decksDirty = false;
+        autosaveTimer.SetOwner(this);
+        Bind(wxEVT_TIMER, &FlashCardFrame::OnAutosave, this, autosaveTimer.GetId());
+        autosaveTimer.Start(AUTOSAVE_INTERVAL);
+
+        // Initialize pins
+        initPin(PIN_ONE);
+        initPin(PIN_TWO);
+        initPin(PIN_THREE);
+    }
     LoadDecks();
 
     aromas.Add("1");
     aromas.Add("2");
     aromas.Add("3");
-
-    // Initialize pins
-    initPin(PIN_ONE);
-    initPin(PIN_TWO);
-    initPin(PIN_THREE);
 }
 
 /**
@@ -86,18 +145,115 @@ void FlashCardFrame::OnDeckSelected(wxCommandEvent& event) {
 */
 void FlashCardFrame::OnClose(wxCloseEvent& event) {
 
-    // Saves the current decks
-    saveDecks(decks);
+    // Saves the current decks, the server owns them when connected
+    if (deckClient) {
+        serverPollTimer.Stop();
+        deckClient->save();
+    } else {
+        autosaveTimer.Stop();
+        WaitForBackgroundSave();
+        saveDecks(decks);
+    }
     event.Skip();
 }
 
+/**
+ * @brief Event handler for the autosave timer.
+ * Saves snapshots of the decks on a worker thread if they were edited.
+ * @param event the wxTimerEvent associated with the event
+*/
+void FlashCardFrame::OnAutosave(wxTimerEvent& event) {
+    bool saving = backgroundSave.valid() && backgroundSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    if (decksDirty && !saving) {
+        backgroundSave = saveDecksInBackground(decks);
+        decksDirty = false;
+    }
+}
+
+/**
+ * @brief Blocks until a running background save has finished writing,
+ * so that the files are not written from two threads at once.
+*/
+void FlashCardFrame::WaitForBackgroundSave() {
+    if (backgroundSave.valid())
+        backgroundSave.wait();
+}
+
+/**
+ * @brief Event handler for the server poll timer.
+ * Applies changes that other stations made.
+ * @param event the wxTimerEvent associated with the event
+*/
+void FlashCardFrame::OnServerPoll(wxTimerEvent& event) {
+    ApplyServerChanges();
+
+    if (!deckClient->isConnected()) {
+        serverPollTimer.Stop();
+        ShowErrorDialog("Lost connection to the deck server: " + deckClient->getLastError());
+    }
+}
+
+/**
+ * @brief Applies the changes pushed by the deck server to the local decks.
+ * This station's own edits arrive the same way, so the cards stay in the
+ * same order as on the server.
+ */
+void FlashCardFrame::ApplyServerChanges() {
+    bool decksAdded = false;
+    for (const DeckNotification& notification : deckClient->pollNotifications()) {
+        std::shared_ptr<FlashCardDeck> deck;
+        for (std::shared_ptr<FlashCardDeck> candidate : decks) {
+            if (candidate->getName() == notification.deckName) {
+                deck = candidate;
+                break;
+            }
+        }
+
+        if (notification.kind == DeckProtocol::DECK_CREATED && !deck) {
+            decks.push_back(std::make_shared<FlashCardDeck>(notification.deckName));
+            decksAdded = true;
+        } else if (notification.kind == DeckProtocol::CARD_ADDED && deck) {
+            deck->addCard(std::make_shared<FlashCard>(notification.question, notification.answer));
+        } else if (notification.kind == DeckProtocol::CARD_REMOVED && deck) {
+            deck->removeCardAt(notification.index);
+        }
+    }
+
+    // Only new decks change the list
+    if (decksAdded)
+        LoadDecks();
+}
+
+/**
+ * @brief Turns a diffuser pin on or off, through the deck server when connected.
+ * @param pin the pin to switch
+ * @param on whether the pin should be on
+ * @returns false if another station owns the pin
+ */
+bool FlashCardFrame::switchPin(int pin, bool on) {
+    if (!deckClient) {
+        if (on)
+            turnOnPin(pin);
+        else
+            turnOffPin(pin);
+        return true;
+    }
+
+    if (!on)
+        return deckClient->releasePin(pin);
+    if (!deckClient->acquirePin(pin) || !deckClient->setPin(pin, true)) {
+        ShowErrorDialog(deckClient->getLastError());
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Loads existing decks into the deckListBox.
  */
 void FlashCardFrame::LoadDecks() {
     for(size_t i = 0; i < decks.size(); i++){
         if (deckListBox->FindString(decks[i]->getName()) == wxNOT_FOUND) {
-            wxString deckSize = std::to_string(decks[i]->getCards().size());
             wxString displayString = decks[i]->getName();
             deckListBox->Append(displayString);
         }
@@ -128,13 +284,16 @@ void FlashCardFrame::OnShowFlashcard(wxCommandEvent& event) {
         wxMessageBox("Please select a deck first.", "Error", wxOK | wxICON_ERROR);
         return;
     }
-    if (currentDeck->getCards().size() <= 0) {
+    if (currentDeck->getCardCount() == 0) {
         wxMessageBox("No FlashCards In Deck", "Error", wxOK | wxICON_ERROR);
         return;
     }
     
-    std::unique_ptr<FlashCardDialog> flashcardDialog = std::make_unique<FlashCardDialog>(this, "Flashcards", currentDeck->getCards());
+    // Images can only be attached to decks this process saves itself
+    HistoryEntry entry = history.begin("Attach Image", { currentDeck });
+    std::unique_ptr<FlashCardDialog> flashcardDialog = std::make_unique<FlashCardDialog>(this, "Flashcards", currentDeck, mediaCache, !deckClient);
     flashcardDialog->ShowModal();
+    CommitHistory(entry);
 }
 
 /**
@@ -148,7 +307,17 @@ void FlashCardFrame::createDeck(wxCommandEvent& event) {
     if (dialog.ShowModal() == wxID_OK) {
         wxString newDeckName = dialog.GetValue();
         if (!newDeckName.IsEmpty()) {
+            if (!isValidDeckName(newDeckName.utf8_string())) {
+                ShowErrorDialog("Deck names cannot start with a dot or contain a slash.");
+                return;
+            }
             if (deckListBox->FindString(newDeckName) == wxNOT_FOUND) {
+                if (deckClient) {
+                    if (!deckClient->createDeck(newDeckName.utf8_string()))
+                        ShowErrorDialog(deckClient->getLastError());
+                    ApplyServerChanges();
+                    return;
+                }
                 std::shared_ptr<FlashCardDeck> deck = std::make_shared<FlashCardDeck>(newDeckName.utf8_string());
                 decks.push_back(deck);
                 LoadDecks();
@@ -202,8 +371,16 @@ void FlashCardFrame::addCard(wxCommandEvent& event) {
 
             // Check if both question and answer are not empty
             if (!question.IsEmpty() && !answer.IsEmpty()) {
+                if (deckClient) {
+                    if (!deckClient->addCard(currentDeck->getName(), question.ToStdString(), answer.ToStdString()))
+                        ShowErrorDialog(deckClient->getLastError());
+                    ApplyServerChanges();
+                    return;
+                }
+                HistoryEntry entry = history.begin("Add Card", { currentDeck });
                 std::shared_ptr<FlashCard> newCard = std::make_shared<FlashCard>(question.ToStdString(), answer.ToStdString());
                 currentDeck->addCard(newCard);
+                CommitHistory(entry);
             } else {
                 wxMessageBox("Please enter both question and answer.", "Error", wxOK | wxICON_ERROR);
             }
@@ -213,6 +390,194 @@ void FlashCardFrame::addCard(wxCommandEvent& event) {
     }
 }
 
+/**
+ * @brief Event handler for the "Sync Library" button click.
+ * Merges the decks with another library folder in both directions, or
+ * imports from or exports to a bundle file.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardFrame::syncLibrary(wxCommandEvent& event) {
+    if (deckClient) {
+        ShowErrorDialog("Syncing is not available while the deck server owns the library. Stop the deck server and restart this app to open the library directly.");
+        return;
+    }
+
+    // Keeps autosave from writing the library while the sync reads and rewrites it,
+    // including from the nested event loops of the dialogs below
+    struct AutosavePause {
+        wxTimer& timer;
+        ~AutosavePause() { timer.Start(AUTOSAVE_INTERVAL); }
+    } autosavePause{ autosaveTimer };
+    autosaveTimer.Stop();
+
+    wxArrayString choices;
+    choices.Add("Sync with another library folder");
+    choices.Add("Import a bundle");
+    choices.Add("Export a bundle");
+    wxSingleChoiceDialog choiceDialog(this, "Choose how to sync:", "Sync Library", choices);
+    if (choiceDialog.ShowModal() != wxID_OK)
+        return;
+
+    // Writes out local edits first so they take part in the sync
+    WaitForBackgroundSave();
+    saveDecks(decks);
+    decksDirty = false;
+
+    SyncReport report;
+    int choice = choiceDialog.GetSelection();
+    if (choice == 0) {
+        wxDirDialog dirDialog(this, "Choose the library folder to sync with");
+        if (dirDialog.ShowModal() != wxID_OK)
+            return;
+        std::string other = dirDialog.GetPath().utf8_string();
+        WaitForBackgroundSave();
+        report = syncLibraries(other, "decks");
+        syncLibraries("decks", other);
+    } else if (choice == 1) {
+        wxFileDialog fileDialog(this, "Choose a bundle to import", "", "", "Aroma bundles (*.aromabundle)|*.aromabundle", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+        if (fileDialog.ShowModal() != wxID_OK)
+            return;
+        WaitForBackgroundSave();
+        report = importBundle(fileDialog.GetPath().utf8_string(), "decks");
+    } else {
+        wxFileDialog fileDialog(this, "Export library as", "", "library.aromabundle", "Aroma bundles (*.aromabundle)|*.aromabundle", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (fileDialog.ShowModal() != wxID_OK)
+            return;
+        WaitForBackgroundSave();
+        if (!exportBundle("decks", fileDialog.GetPath().utf8_string()))
+            ShowErrorDialog("Could not write the bundle.");
+        return;
+    }
+
+    // Reloads the merged library, keeping the current deck selected
+    wxString currentName = currentDeck ? wxString::FromUTF8(currentDeck->getName()) : wxString();
+    decks = loadDecks();
+    currentDeck = nullptr;
+    history.clear();
+    UpdateHistoryButtons();
+    LoadDecks();
+    if (!currentName.IsEmpty())
+        LoadFlashcards(currentName);
+
+    wxMessageBox(wxString::Format("Decks changed: %d\nCards added: %d\nCards removed: %d\nAnswers replaced: %d\nConflicts kept: %d",
+                                  report.decksChanged, report.cardsAdded, report.cardsRemoved, report.cardsReplaced, report.conflictsKept), "Sync Library");
+}
+
+/**
+ * @brief Event handler for the "Find Duplicates" button click.
+ * Lists clusters of near-identical cards across all decks, and merges the
+ * clusters the user selects into their first card.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardFrame::findDuplicateCards(wxCommandEvent& event) {
+    if (deckClient) {
+        ShowErrorDialog("Merging duplicates is not available while the deck server owns the library. Stop the deck server and restart this app to open the library directly.");
+        return;
+    }
+
+    std::vector<DuplicateCluster> clusters;
+    {
+        wxBusyCursor busy;
+        clusters = findDuplicates(decks);
+    }
+    if (clusters.empty()) {
+        wxMessageBox("No duplicate cards found.", "Find Duplicates");
+        return;
+    }
+
+    // Describes each cluster by its size, similarity, every member's card and its deck
+    wxArrayString choices;
+    for (const DuplicateCluster& cluster : clusters) {
+        wxString members;
+        for (const CardRef& ref : cluster.cards) {
+            members += wxString::Format("%s%s: %s [%s]", members.IsEmpty() ? "" : "  |  ", wxString::FromUTF8(ref.card->getQuestion()),
+                                        wxString::FromUTF8(ref.card->getAnswer()), wxString::FromUTF8(ref.deck->getName()));
+        }
+        choices.Add(wxString::Format("%zu cards (%d%%): %s", cluster.cards.size(), int(cluster.similarity * 100), members));
+    }
+
+    wxMultiChoiceDialog dialog(this, "Select the clusters to merge into their first card:", "Find Duplicates", choices);
+    if (dialog.ShowModal() != wxID_OK)
+        return;
+
+    std::vector<DuplicateCluster> selected;
+    for (int index : dialog.GetSelections())
+        selected.push_back(clusters[index]);
+    HistoryEntry entry = history.begin("Merge Duplicates", decks);
+    int removed = mergeClusters(selected);
+    CommitHistory(entry);
+    wxMessageBox(wxString::Format("Removed %d duplicate cards.", removed), "Find Duplicates");
+}
+
+/**
+ * @brief Event handler for the "Batch Edit" button click.
+ * Opens the batch edit dialog and applies the confirmed batch in one step.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardFrame::batchEdit(wxCommandEvent& event) {
+    if (deckClient) {
+        ShowErrorDialog("Batch editing is not available while the deck server owns the library. Stop the deck server and restart this app to open the library directly.");
+        return;
+    }
+
+    BatchEditDialog dialog(this, decks);
+    if (dialog.ShowModal() != wxID_OK)
+        return;
+
+    EditBatch batch = dialog.getBatch();
+    if (batch.size() == 0)
+        return;
+    HistoryEntry entry = history.begin("Batch Edit", batch.getDecks());
+    batch.apply();
+    CommitHistory(entry);
+    wxMessageBox(wxString::Format("Edited %zu cards.", batch.size()), "Batch Edit");
+}
+
+/**
+ * @brief Event handler for the "Undo" button click.
+ * Restores the decks changed by the most recent operation.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardFrame::undo(wxCommandEvent& event) {
+    if (history.undo())
+        decksDirty = true;
+    UpdateHistoryButtons();
+}
+
+/**
+ * @brief Event handler for the "Redo" button click.
+ * Reapplies the most recently undone operation.
+ * @param event The wxCommandEvent associated with the event.
+ */
+void FlashCardFrame::redo(wxCommandEvent& event) {
+    if (history.redo())
+        decksDirty = true;
+    UpdateHistoryButtons();
+}
+
+/**
+ * @brief Records a finished operation in the undo history.
+ * @param entry The entry returned by history.begin before the operation.
+ */
+void FlashCardFrame::CommitHistory(const HistoryEntry& entry) {
+    if (deckClient)
+        return;
+    if (history.commit(entry))
+        decksDirty = true;
+    UpdateHistoryButtons();
+}
+
+/**
+ * @brief Enables the undo and redo buttons when they have something to do,
+ * and names the operation they would affect in their tooltips.
+ */
+void FlashCardFrame::UpdateHistoryButtons() {
+    undoButton->Enable(history.canUndo());
+    redoButton->Enable(history.canRedo());
+    undoButton->SetToolTip("Undo " + wxString::FromUTF8(history.undoDescription()));
+    redoButton->SetToolTip("Redo " + wxString::FromUTF8(history.redoDescription()));
+}
+
 /**
  * @brief Event handler for toggling the aroma library dialog.
  * Displays the aroma library dialog for selecting aromas.
@@ -236,16 +601,21 @@ void FlashCardFrame::toggleAromaSync(wxCommandEvent& event) {
         wxMessageBox("Aroma Sync Now Off", "Aroma Sync");
         int num;
         currentAroma.ToInt(&num);
-        turnOffPin(num);
+        if (aromaPin(num) != -1)
+            switchPin(aromaPin(num), false);
     }else {
         aromaSync = true;
         if(currentAroma.IsEmpty()){
             wxMessageBox("Aroma Sync Now On, Please use the Library to select", "Aroma Sync");
         }else {
-            wxMessageBox("Aroma Sync Now On, Current Selection: " + currentAroma, "Aroma Sync");
             int num;
             currentAroma.ToInt(&num);
-            turnOnPin(num);
+            if (aromaPin(num) == -1 || !switchPin(aromaPin(num), true)) {
+                aromaSync = false;
+                aromaToggle->SetValue(false);
+                return;
+            }
+            wxMessageBox("Aroma Sync Now On, Current Selection: " + currentAroma, "Aroma Sync");
         }
     }
 }
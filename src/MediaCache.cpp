@@ -0,0 +1,213 @@
+/**
+ * @file MediaCache.cpp
+ * @brief Implementation of the MediaCache class.
+ * @author Ben Namo
+ */
+
+#include "../include/MediaCache.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+
+/**
+ * @brief Constructor for the cache, starts the decoding threads
+ * @param maxBytes the most decoded pixel data to keep
+ * @param threadCount number of decoding threads, 0 for one per core
+*/
+MediaCache::MediaCache(size_t maxBytes, unsigned threadCount) : maxBytes(maxBytes), usedBytes(0), stopping(false)
+{
+    threadCount = threadCountFor(threadCount);
+    for (unsigned t = 0; t < threadCount; t++)
+        workers.emplace_back(&MediaCache::workerLoop, this);
+}
+
+/**
+ * @brief Destructor, drops queued work and waits for running decodes to end
+*/
+MediaCache::~MediaCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobsAvailable.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+/**
+ * @brief Gets a decoded image if it is already cached, marking it as
+ * recently used. Never blocks on decoding.
+ * @param path the image file
+ * @param maxSize the size the image was scaled to fit
+ * @returns the image, or a null pointer if it is not cached
+*/
+std::shared_ptr<const DecodedImage> MediaCache::get(const std::string& path, const wxSize& maxSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(keyFor(path, maxSize));
+    if (it == index.end())
+        return nullptr;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->image;
+}
+
+/**
+ * @brief Decodes an image ahead of the queue of prefetches. The callback is
+ * run on the UI thread once the image is in the cache, and is dropped if
+ * the image cannot be decoded.
+ * @param path the image file
+ * @param maxSize the size to scale the image to fit
+ * @param onReady called on the UI thread when the image is ready
+*/
+void MediaCache::request(const std::string& path, const wxSize& maxSize, std::function<void()> onReady)
+{
+    enqueue({path, maxSize, keyFor(path, maxSize), onReady}, true);
+}
+
+/**
+ * @brief Decodes an image in the background if it is not cached yet, for
+ * cards the user is likely to look at next
+ * @param path the image file
+ * @param maxSize the size to scale the image to fit
+*/
+void MediaCache::prefetch(const std::string& path, const wxSize& maxSize)
+{
+    enqueue({path, maxSize, keyFor(path, maxSize), nullptr}, false);
+}
+
+/**
+ * @brief Builds the cache key of an image at a display size
+ * @param path the image file
+ * @param maxSize the display size
+ * @returns the key
+*/
+std::string MediaCache::keyFor(const std::string& path, const wxSize& maxSize)
+{
+    return path + "@" + std::to_string(maxSize.GetWidth()) + "x" + std::to_string(maxSize.GetHeight());
+}
+
+/**
+ * @brief Loads an image file and scales it down to fit a size, on the
+ * calling worker thread
+ * @param path the image file
+ * @param maxSize the size to fit
+ * @returns the pixels, or a null pointer if the file cannot be decoded
+*/
+std::shared_ptr<const DecodedImage> MediaCache::decode(const std::string& path, const wxSize& maxSize)
+{
+    wxLogNull noLog;
+    wxImage image;
+    if (!image.LoadFile(wxString::FromUTF8(path), wxBITMAP_TYPE_ANY) || !image.IsOk())
+        return nullptr;
+
+    // Scales to fit while keeping the aspect ratio, never enlarging
+    double scale = std::min({1.0, double(maxSize.GetWidth()) / image.GetWidth(), double(maxSize.GetHeight()) / image.GetHeight()});
+    if (scale < 1.0)
+        image.Rescale(std::max(1, int(image.GetWidth() * scale)), std::max(1, int(image.GetHeight() * scale)), wxIMAGE_QUALITY_HIGH);
+
+    std::shared_ptr<DecodedImage> decoded = std::make_shared<DecodedImage>();
+    decoded->width = image.GetWidth();
+    decoded->height = image.GetHeight();
+    size_t pixels = size_t(decoded->width) * decoded->height;
+    decoded->rgb.assign(image.GetData(), image.GetData() + pixels * 3);
+    if (image.HasAlpha())
+        decoded->alpha.assign(image.GetAlpha(), image.GetAlpha() + pixels);
+    return decoded;
+}
+
+/**
+ * @brief Queues an image for decoding unless it is cached or already queued
+ * @param job the decode to queue
+ * @param urgent whether to decode it before queued prefetches
+*/
+void MediaCache::enqueue(Job job, bool urgent)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index.count(job.key)) {
+            if (job.onReady)
+                wxTheApp->CallAfter(job.onReady);
+            return;
+        }
+
+        // A second request for an image being decoded just waits for the first
+        auto waiting = inFlight.find(job.key);
+        if (waiting != inFlight.end()) {
+            if (job.onReady)
+                waiting->second.push_back(job.onReady);
+            if (urgent) {
+                auto queued = std::find_if(jobs.begin(), jobs.end(), [&](const Job& other) { return other.key == job.key; });
+                if (queued != jobs.end()) {
+                    Job moved = *queued;
+                    jobs.erase(queued);
+                    jobs.push_front(moved);
+                }
+            }
+            return;
+        }
+
+        inFlight[job.key] = job.onReady ? std::vector<std::function<void()>>{ job.onReady } : std::vector<std::function<void()>>{};
+        job.onReady = nullptr;
+        if (urgent)
+            jobs.push_front(job);
+        else
+            jobs.push_back(job);
+    }
+    jobsAvailable.notify_one();
+}
+
+/**
+ * @brief Adds a decoded image to the cache, evicting the least recently
+ * used images until it fits. Must be called with the mutex held.
+ * @param key the image's cache key
+ * @param image the decoded image
+*/
+void MediaCache::insert(const std::string& key, std::shared_ptr<const DecodedImage> image)
+{
+    entries.push_front({key, image});
+    index[key] = entries.begin();
+    usedBytes += image->bytes();
+
+    // Always keeps the newest image, even if it alone is over the limit
+    while (usedBytes > maxBytes && entries.size() > 1) {
+        Entry& oldest = entries.back();
+        usedBytes -= oldest.image->bytes();
+        index.erase(oldest.key);
+        entries.pop_back();
+    }
+}
+
+/**
+ * @brief Takes jobs off the queue and decodes them until the cache is destroyed
+*/
+void MediaCache::workerLoop()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobsAvailable.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        std::shared_ptr<const DecodedImage> image = decode(job.path, job.maxSize);
+
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (image)
+                insert(job.key, image);
+            callbacks = inFlight[job.key];
+            inFlight.erase(job.key);
+        }
+        if (image) {
+            for (std::function<void()>& callback : callbacks)
+                wxTheApp->CallAfter(callback);
+        }
+    }
+}
@@ -0,0 +1,185 @@
+/**
+ * @file MediaStore.cpp
+ * @brief Stores media under the hash of its content, so a file attached to
+ * many cards is kept once, and records which cards use which media.
+ * @author Ben Namo
+ */
+
+#include "../include/MediaStore.h"
+#include "../include/DeckSync.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+/**
+ * @brief Hashes the content of a file into 128 bits, as two 64 bit FNV-1a
+ * hashes with different starting values
+ * @param path the file to hash
+ * @returns 32 hex digits, or an empty string if the file cannot be read
+*/
+std::string hashMediaFile(const std::string& path)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        return "";
+
+    uint64_t first = 0xCBF29CE484222325ULL;
+    uint64_t second = 0x84222325CBF29CE4ULL;
+    char chunk[64 * 1024];
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0) {
+        for (std::streamsize i = 0; i < input.gcount(); i++) {
+            unsigned char c = chunk[i];
+            first = (first ^ c) * 0x100000001B3ULL;
+            second = (second ^ c ^ 0x5A) * 0x100000001B3ULL;
+        }
+    }
+
+    char hex[33];
+    std::snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)first, (unsigned long long)second);
+    return hex;
+}
+
+/**
+ * @brief Gets where a media file is stored
+ * @param libraryDirectory the library directory
+ * @param hash the media's content hash
+ * @returns the path of the stored file
+*/
+std::string mediaPath(const std::string& libraryDirectory, const std::string& hash)
+{
+    return (std::filesystem::path(libraryDirectory) / MEDIA_DIRECTORY / hash).string();
+}
+
+/**
+ * @brief Copies a file into a library's media store, unless identical
+ * content is already stored
+ * @param libraryDirectory the library directory
+ * @param sourcePath the file to import
+ * @returns the media's content hash, or an empty string on failure
+*/
+std::string importMedia(const std::string& libraryDirectory, const std::string& sourcePath)
+{
+    std::string hash = hashMediaFile(sourcePath);
+    if (hash.empty()) {
+        std::cerr << "Error opening media file: " << sourcePath << std::endl;
+        return "";
+    }
+
+    std::error_code error;
+    std::filesystem::path target = mediaPath(libraryDirectory, hash);
+    if (std::filesystem::exists(target, error))
+        return hash;
+
+    // Copies to a temporary name first so a partial copy is never mistaken for the media
+    std::filesystem::create_directories(target.parent_path(), error);
+    std::filesystem::path partial = target;
+    partial += ".partial";
+    std::filesystem::copy_file(sourcePath, partial, std::filesystem::copy_options::overwrite_existing, error);
+    if (!error)
+        std::filesystem::rename(partial, target, error);
+    if (error) {
+        std::cerr << "Error storing media file: " << sourcePath << std::endl;
+        return "";
+    }
+    return hash;
+}
+
+/**
+ * @brief Writes which media each card of a deck uses, one line per card
+ * with media: the card's content hash followed by its media hashes. Keying
+ * by content rather than position keeps the media on the right card when
+ * the deck file is rewritten with cards added or removed. Identical cards
+ * share one line.
+ * @param deck the deck to record
+ * @param libraryDirectory the library directory
+ * @returns true if the references were written
+*/
+bool saveMediaRefs(const std::shared_ptr<FlashCardDeck> deck, const std::string& libraryDirectory)
+{
+    std::filesystem::path path = std::filesystem::path(libraryDirectory) / MEDIA_DIRECTORY / (deck->getName() + ".refs");
+    std::ostringstream refs;
+    for (std::shared_ptr<FlashCard> card : deck->getCards()) {
+        std::vector<std::string> media = card->getMedia();
+        if (!media.empty()) {
+            refs << std::hex << hashCard(card->getQuestion(), card->getAnswer());
+            for (const std::string& hash : media)
+                refs << " " << hash;
+            refs << "\n";
+        }
+    }
+
+    // Decks without media leave no references file behind
+    std::error_code error;
+    if (refs.str().empty()) {
+        std::filesystem::remove(path, error);
+        return true;
+    }
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::ofstream refsFile(path);
+    refsFile << "aroma-refs 2\n" << refs.str();
+    return bool(refsFile);
+}
+
+/**
+ * @brief Attaches the recorded media to the cards of a freshly loaded deck.
+ * Files without a header come from before references were keyed by
+ * content, and give the card's index instead of its hash.
+ * @param deck the deck to update
+ * @param libraryDirectory the library directory
+*/
+void loadMediaRefs(const std::shared_ptr<FlashCardDeck> deck, const std::string& libraryDirectory)
+{
+    std::filesystem::path path = std::filesystem::path(libraryDirectory) / MEDIA_DIRECTORY / (deck->getName() + ".refs");
+    std::ifstream refsFile(path);
+    std::string line;
+    if (!std::getline(refsFile, line))
+        return;
+    bool byIndex = line != "aroma-refs 2";
+    if (byIndex) {
+        refsFile.clear();
+        refsFile.seekg(0);
+    }
+
+    std::vector<std::pair<uint64_t, std::vector<std::string>>> entries;
+    while (std::getline(refsFile, line)) {
+        std::istringstream iss(line);
+        uint64_t key;
+        if (!(iss >> (byIndex ? std::dec : std::hex) >> key))
+            continue;
+
+        std::vector<std::string> media;
+        std::string hash;
+        while (iss >> hash)
+            media.push_back(hash);
+        entries.push_back({key, media});
+    }
+
+    if (byIndex) {
+        for (const auto& entry : entries) {
+            std::shared_ptr<FlashCard> card = deck->getCard(int(entry.first));
+            if (!card)
+                continue;
+            std::shared_ptr<FlashCard> withMedia = std::make_shared<FlashCard>(card->getQuestion(), card->getAnswer());
+            withMedia->setMedia(entry.second);
+            deck->setCard(int(entry.first), withMedia);
+        }
+        return;
+    }
+
+    std::unordered_map<uint64_t, std::vector<std::string>> byHash(entries.begin(), entries.end());
+    int index = 0;
+    for (std::shared_ptr<FlashCard> card : deck->getCards()) {
+        auto media = byHash.find(hashCard(card->getQuestion(), card->getAnswer()));
+        if (media != byHash.end()) {
+            std::shared_ptr<FlashCard> withMedia = std::make_shared<FlashCard>(card->getQuestion(), card->getAnswer());
+            withMedia->setMedia(media->second);
+            deck->setCard(index, withMedia);
+        }
+        index++;
+    }
+}
@@ -0,0 +1,30 @@
+/**
+ * @file DeckServerMain.cpp
+ * @brief Entry point for the deck server daemon.
+ * @author Ben Namo
+ */
+
+#include "../../include/DeckServer.h"
+
+#include <csignal>
+#include <iostream>
+
+/**
+ * @brief Runs the deck server until it is interrupted
+ * @param argc number of arguments
+ * @param argv optional socket path as the first argument
+ * @returns 0 on a clean shutdown, 1 if the server could not start
+*/
+int main(int argc, char* argv[])
+{
+    DeckServer server(argc > 1 ? argv[1] : DeckProtocol::DEFAULT_SOCKET_PATH);
+    if (!server.start())
+        return 1;
+
+    // SIGINT and SIGTERM are handled by the server's event loop
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cout << "Deck server listening" << std::endl;
+    server.run();
+    return 0;
+}